@@ -12,7 +12,8 @@
 namespace libqimg::TileMode {
 
     // Basic float RGBA Colors
-    struct Color {
+    // Aligned to 16 bytes, a color fills one 128-bit register and is a pixel of an interleaved collection
+    struct alignas(16) Color {
 
         float r = 0.0f;
         float g = 0.0f;
@@ -24,15 +25,20 @@ namespace libqimg::TileMode {
         Color(float r, float g, float b):r(r), g(g), b(b) {};
         Color(float r, float g, float b, float a):r(r), g(g), b(b), a(a) {};
         /* Vector-Like operators */
-        inline Color operator+(const Color& x) { return Color(r + x.r, g + x.g, b + x.b, a + x.a); }
-        inline Color operator-(const Color& x) { return Color(r - x.r, g - x.g, b - x.b, a - x.a); }
-        inline Color operator*(float x) { return Color(r * x, g * x, b * x, a * x); }
-        inline Color operator/(float x) { return Color(r / x, g / x, b / x, a / x); }
+        inline Color operator+(const Color& x) const { return Color(r + x.r, g + x.g, b + x.b, a + x.a); }
+        inline Color operator-(const Color& x) const { return Color(r - x.r, g - x.g, b - x.b, a - x.a); }
+        inline Color operator*(float x) const { return Color(r * x, g * x, b * x, a * x); }
+        inline Color operator/(float x) const { return Color(r / x, g / x, b / x, a / x); }
         /* Vector-Like self operators */
-        inline Color operator+=(const Color& x) { return Color(r + x.r, g + x.g, b + x.b, a + x.a); }
-        inline Color operator-=(const Color& x) { return Color(r - x.r, g - x.g, b - x.b, a - x.a); }
-        inline Color operator*=(float x) { return Color(r * x, g * x, b * x, a * x); }
-        inline Color operator/=(float x) { return Color(r / x, g / x, b / x, a / x); }
+        inline Color& operator+=(const Color& x) { r += x.r; g += x.g; b += x.b; a += x.a; return *this; }
+        inline Color& operator-=(const Color& x) { r -= x.r; g -= x.g; b -= x.b; a -= x.a; return *this; }
+        inline Color& operator*=(float x) { r *= x; g *= x; b *= x; a *= x; return *this; }
+        inline Color& operator/=(float x) { r /= x; g /= x; b /= x; a /= x; return *this; }
+
+        // Linear interpolation of every channel, the same formula as math::lerp
+        inline static Color lerp(const Color& begin, const Color& end, float t) {
+            return (end - begin) * t + begin;
+        }
 
         // Lightness = (max(R, G, B) + min(R, G, B)) / 2
         inline float lightness() { return (math::max(r, math::max(g, b)) + math::min(r, math::min(g, b))) / 2.0f; }
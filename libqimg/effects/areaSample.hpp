@@ -13,32 +13,30 @@
 #include "../fmat.hpp"
 #include "../fmc.hpp"
 #include "../multiThread.hpp"
+#include "../summedAreaTable.hpp"
 
 namespace libqimg::Effects::Sample {
 
-    // Averave Area Sample. MultiThreading is not recommended for resample effects.
+    // Averave Area Sample. Area averages are answered by a summed-area table of source.
     void areaSample(
         FMAT& source, 
         FMAT& target, 
         MTEXEC_PARAMS
     ) {
         
-        auto function = [&source](FMAT_MTEXEC_PARAMS) {
-            
-            matrix(current) = source.average(
-                PointF(
-                    (float)current.x * (float)source.width() / (float)matrix.width(),
-                    (float)current.y * (float)source.height() / (float)matrix.height()
-                ),
-                PointF(
-                    (float)(current.x + 1) * (float)source.width() / (float)matrix.width(),
-                    (float)(current.y + 1) * (float)source.height() / (float)matrix.height()
-                )
-            );
-        };
-
-        if(!MultiThread::multiThreadExecute(target, function, taskName, threadCount))
-            target.parameterizedForeach(function); 
+        SummedAreaTable table = SummedAreaTable(source, threadCount);
+        float scaleX = (float)source.width() / (float)target.width();
+        float scaleY = (float)source.height() / (float)target.height();
+
+        MultiThread::multiThreadExecuteSpan(target, {}, [&table, scaleX, scaleY](FMAT_SPAN_PARAMS) {
+            float top = (float)y * scaleY, bottom = (float)(y + 1) * scaleY;
+            for(int x = begin; x < end; x++)
+                row[x] = table.average(
+                    PointF((float)x * scaleX, top),
+                    PointF((float)(x + 1) * scaleX, bottom));
+        }, taskName, threadCount);
+
+        table.dispose();
     }
 
     // Averave Area Sample. MultiThreading is not recommended for resample effects.
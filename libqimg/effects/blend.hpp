@@ -12,6 +12,7 @@
 #include "libqimg_math.hpp"
 #include "../fmat.hpp"
 #include "../fmc.hpp"
+#include "../fmcn.hpp"
 #include "../multiThread.hpp"
 
 namespace libqimg::Effects {
@@ -20,17 +21,28 @@ namespace libqimg::Effects {
 
     // Blend Effect for FMAT
     // Convert every float into another float value, function parameters: (float& bottop, float& top)
-    template <class Function>
+    // Matrices of other element types are converted to float and back around converter.
+    template <class Function, typename Bottom, typename Top, typename Target>
     void blend(
-        FMAT& bottom, 
-        FMAT& top,
-        FMAT& target, 
+        Matrix<Bottom>& bottom, 
+        Matrix<Top>& top,
+        Matrix<Target>& target, 
         const Function& converter,
         MTEXEC_PARAMS
     ) {
         
-        auto function = [&bottom, &top, &converter](FMAT_MTEXEC_PARAMS) {
-            reference = converter(bottom(current), top(current));
+        if(bottom.canvasSize() == target.canvasSize() && top.canvasSize() == target.canvasSize()) {
+            MultiThread::multiThreadExecuteSpan(target, {}, [&bottom, &top, &converter](Target* row, const float* const*, int y, int begin, int end) {
+                const Bottom* bottomRow = bottom.rowPtr(y);
+                const Top* topRow = top.rowPtr(y);
+                for(int x = begin; x < end; x++)
+                    row[x] = Element<Target>::fromFloat(converter(Element<Bottom>::toFloat(bottomRow[x]), Element<Top>::toFloat(topRow[x])));
+            }, taskName, threadCount);
+            return;
+        }
+
+        auto function = [&bottom, &top, &converter](Target& reference, Point current, Matrix<Target>&) {
+            reference = Element<Target>::fromFloat(converter(bottom.pixelAccess(current.x, current.y), top.pixelAccess(current.x, current.y)));
         };
         
         if(!MultiThread::multiThreadExecute(target, function, taskName, threadCount))
@@ -39,10 +51,10 @@ namespace libqimg::Effects {
     }
     // Effect self
     // Convert every float into another float value, function parameters: (float& bottop, float& top)
-    template <class Function>
+    template <class Function, typename Bottom, typename Top>
     void blend(
-        FMAT& bottom, 
-        FMAT& top,
+        Matrix<Bottom>& bottom, 
+        Matrix<Top>& top,
         const Function& converter,
         MTEXEC_PARAMS
     ) {
@@ -50,11 +62,11 @@ namespace libqimg::Effects {
     }
     // Blend Effect for FMC
     // Convert every float into another float value, function parameters: (float& bottop, float& top)
-    template <class Function>
+    template <class Function, typename Bottom, typename Top, typename Target>
     void blend(
-        FMC& bottom, 
-        FMC& top,
-        FMC& target, 
+        MatrixCollection<Bottom>& bottom, 
+        MatrixCollection<Top>& top,
+        MatrixCollection<Target>& target, 
         const Function& converter,
         MTEXEC_PARAMS
     ) {
@@ -63,10 +75,10 @@ namespace libqimg::Effects {
     }
     // Effect self
     // Convert every float into another float value, function parameters: (float& bottop, float& top)
-    template <class Function>
+    template <class Function, typename Bottom, typename Top>
     void blend(
-        FMC& bottom, 
-        FMC& top,
+        MatrixCollection<Bottom>& bottom, 
+        MatrixCollection<Top>& top,
         const Function& converter,
         MTEXEC_PARAMS
     ) {
@@ -75,11 +87,11 @@ namespace libqimg::Effects {
     }
     // Blend Effect for FMC, but use same the FMAT for each channel.
     // Convert every float into another float value, function parameters: (float& bottop, float& top)
-    template <class Function>
+    template <class Function, typename Bottom, typename Top, typename Target>
     void blend(
-        FMC& bottom, 
-        FMAT& top,
-        FMC& target, 
+        MatrixCollection<Bottom>& bottom, 
+        Matrix<Top>& top,
+        MatrixCollection<Target>& target, 
         const Function& converter,
         MTEXEC_PARAMS
     ) {
@@ -88,16 +100,86 @@ namespace libqimg::Effects {
     }
     // Effect self
     // Convert every float into another float value, function parameters: (float& bottop, float& top)
-    template <class Function>
+    template <class Function, typename Bottom, typename Top>
     void blend(
-        FMC& bottom, 
-        FMAT& top,
+        MatrixCollection<Bottom>& bottom, 
+        Matrix<Top>& top,
         const Function& converter,
         MTEXEC_PARAMS
     ) {
         for(int i = 0; i < bottom.count(); i++)
             blend(bottom[i], top, bottom[i], converter, threadCount, taskName);
     }
+    // Blend Effect for FMCN, every channel of a row segment is blended by one task
+    // Convert every float into another float value, function parameters: (float& bottop, float& top)
+    template <class Function, int N>
+    void blend(
+        FixedMatrixCollection<N>& bottom, 
+        FixedMatrixCollection<N>& top,
+        FixedMatrixCollection<N>& target, 
+        const Function& converter,
+        MTEXEC_PARAMS
+    ) {
+        if(bottom.canvasSize() != target.canvasSize() || top.canvasSize() != target.canvasSize()) {
+            for(int i = 0; i < N; i++)
+                blend(bottom[i], top[i], target[i], converter, threadCount, taskName);
+            return;
+        }
+        MultiThread::multiThreadExecuteSpan(target, {}, [&bottom, &top, &converter](FMCN_SPAN_PARAMS) {
+            for(int ch = 0; ch < N; ch++) {
+                const float* bottomRow = bottom[ch].rowPtr(y);
+                const float* topRow = top[ch].rowPtr(y);
+                for(int x = begin; x < end; x++)
+                    rows[ch][x] = converter(bottomRow[x], topRow[x]);
+            }
+        }, taskName, threadCount);
+    }
+    // Effect self
+    // Convert every float into another float value, function parameters: (float& bottop, float& top)
+    template <class Function, int N>
+    void blend(
+        FixedMatrixCollection<N>& bottom, 
+        FixedMatrixCollection<N>& top,
+        const Function& converter,
+        MTEXEC_PARAMS
+    ) {
+        blend(bottom, top, bottom, converter, threadCount, taskName);
+    }
+    // Blend Effect for FMCN, but use same the FMAT for each channel.
+    // Convert every float into another float value, function parameters: (float& bottop, float& top)
+    template <class Function, int N>
+    void blend(
+        FixedMatrixCollection<N>& bottom, 
+        FMAT& top,
+        FixedMatrixCollection<N>& target, 
+        const Function& converter,
+        MTEXEC_PARAMS
+    ) {
+        if(bottom.canvasSize() != target.canvasSize() || top.canvasSize() != target.canvasSize()) {
+            for(int i = 0; i < N; i++)
+                blend(bottom[i], top, target[i], converter, threadCount, taskName);
+            return;
+        }
+        MultiThread::multiThreadExecuteSpan(target, { &top }, [&bottom, &converter](FMCN_SPAN_PARAMS) {
+            const float* topRow = sources[0];
+            for(int ch = 0; ch < N; ch++) {
+                const float* bottomRow = bottom[ch].rowPtr(y);
+                for(int x = begin; x < end; x++)
+                    rows[ch][x] = converter(bottomRow[x], topRow[x]);
+            }
+        }, taskName, threadCount);
+    }
+    // Effect self
+    // Convert every float into another float value, function parameters: (float& bottop, float& top)
+    template <class Function, int N>
+    void blend(
+        FixedMatrixCollection<N>& bottom, 
+        FMAT& top,
+        const Function& converter,
+        MTEXEC_PARAMS
+    ) {
+        blend(bottom, top, bottom, converter, threadCount, taskName);
+    }
     
 }
 
@@ -13,11 +13,103 @@
 #include "../../fmat.hpp"
 #include "../../fmc.hpp"
 #include "../../multiThread.hpp"
+#include "../../matrixPool.hpp"
 #include "../convolution.hpp"
 
 namespace libqimg::Effects::Blur {
 
-    // Gaussian Blur
+    /*
+        Box Blur: running sums, the cost of a pixel does not depend on the radius
+    */
+
+    // Upper bound of columns processed by a single task in the vertical pass
+    const int BOXBLUR_COLUMN_GRAIN = 128;
+
+    // Horizontal box average of source written to target, both must have the same size
+    void boxBlurHorizontal(
+        FMAT& source, 
+        FMAT& target, 
+        int radius, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        MTEXEC_PARAMS
+    ) {
+        int width = source.width();
+        double scale = 1.0 / (double)(radius * 2 + 1);
+
+        // Interior segments slide over the row directly, border segments read through the edge mode
+        MultiThread::multiThreadExecuteSplit(target, Point(radius, 0), Point(width - radius, source.height()),
+            [&source, radius, scale]
+            (FMAT_SPLIT_PARAMS) {
+
+            const float* input = source.rowPtr(y);
+            double sum = 0.0;
+            for(int dx = -radius; dx <= radius; dx++)
+                sum += input[begin + dx];
+            row[begin] = (float)(sum * scale);
+            for(int x = begin + 1; x < end; x++) {
+                sum += (double)input[x + radius] - (double)input[x - radius - 1];
+                row[x] = (float)(sum * scale);
+            }
+        },
+            [&source, radius, edgeMode, scale]
+            (FMAT_SPLIT_PARAMS) {
+
+            double sum = 0.0;
+            for(int dx = -radius; dx <= radius; dx++)
+                sum += source.pixelAccess(begin + dx, y, edgeMode);
+            row[begin] = (float)(sum * scale);
+            for(int x = begin + 1; x < end; x++) {
+                sum += (double)source.pixelAccess(x + radius, y, edgeMode) - (double)source.pixelAccess(x - radius - 1, y, edgeMode);
+                row[x] = (float)(sum * scale);
+            }
+        }, taskName, threadCount);
+    }
+
+    // Vertical box average of source written to target, both must have the same size
+    void boxBlurVertical(
+        FMAT& source, 
+        FMAT& target, 
+        int radius, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        MTEXEC_PARAMS
+    ) {
+        int width = source.width(), height = source.height();
+        double scale = 1.0 / (double)(radius * 2 + 1);
+        int bandWidth = MultiThread::columnBandWidth(source.canvasSize(), threadCount, BOXBLUR_COLUMN_GRAIN);
+        int bandCount = (width + bandWidth - 1) / bandWidth;
+
+        // Each task slides a row of column sums from top to bottom
+        MultiThread::parallelFor(bandCount, [&](int band) {
+            int begin = band * bandWidth;
+            int end = math::min(begin + bandWidth, width);
+            double sums[BOXBLUR_COLUMN_GRAIN];
+            auto accumulate = [&](int y, double sign) {
+                if(y >= 0 && y < height) {
+                    const float* input = source.rowPtr(y);
+                    for(int x = begin; x < end; x++)
+                        sums[x - begin] += sign * input[x];
+                } else {
+                    for(int x = begin; x < end; x++)
+                        sums[x - begin] += sign * source.pixelAccess(x, y, edgeMode);
+                }
+            };
+            for(int x = begin; x < end; x++)
+                sums[x - begin] = 0.0;
+            for(int dy = -radius; dy <= radius; dy++)
+                accumulate(dy, 1.0);
+            for(int y = 0; y < height; y++) {
+                if(y > 0) {
+                    accumulate(y + radius, 1.0);
+                    accumulate(y - radius - 1, -1.0);
+                }
+                float* output = target.rowPtr(y);
+                for(int x = begin; x < end; x++)
+                    output[x] = (float)(sums[x - begin] * scale);
+            }
+        }, threadCount);
+    }
+
+    // Box Blur
     void boxBlur(
         FMAT& source, 
         FMAT& target, 
@@ -27,14 +119,17 @@ namespace libqimg::Effects::Blur {
         MTEXEC_PARAMS
     ) {
 
-        FMAT canvas = FMAT(target.canvasSize());
-        Convolution::convolute(source, canvas, Point(radiusX, 0), 1, [](CONV_KERNFUNC_PARAMS) {
-            return 1.0f;
-        }, edgeMode, true, threadCount, taskName);
-        Convolution::convolute(canvas, target, Point(0, radiusY), 1, [](CONV_KERNFUNC_PARAMS) {
-            return 1.0f;
-        }, edgeMode, true, threadCount, taskName);
-        canvas.dispose();
+        MatrixArena arena;
+        FMAT canvas = arena.acquire(target.canvasSize());
+        if(source.canvasSize() == target.canvasSize()) {
+            boxBlurHorizontal(source, canvas, radiusX, edgeMode, threadCount, taskName);
+            boxBlurVertical(canvas, target, radiusY, edgeMode, threadCount, taskName);
+        } else {
+            Convolution::convolute(source, canvas, Point(radiusX, 0), 1, [](CONV_KERNFUNC_PARAMS) {
+                return 1.0f;
+            }, edgeMode, true, threadCount, taskName);
+            boxBlurVertical(canvas, target, radiusY, edgeMode, threadCount, taskName);
+        }
 
     }
 
@@ -45,12 +140,11 @@ namespace libqimg::Effects::Blur {
         TileMode::TileMode edgeMode = TileMode::clamp,
         MTEXEC_PARAMS
     ) {
-        FMAT cache = FMAT::copy(source);
-        boxBlur(cache, source, radiusX, radiusY, edgeMode, threadCount, taskName);
-        cache.dispose();
+        // Source is read completely before the vertical pass writes, no copy is needed
+        boxBlur(source, source, radiusX, radiusY, edgeMode, threadCount, taskName);
     }
     
-    // Gaussian Blur
+    // Box Blur
     void boxBlur(
         FMC& source, 
         FMC& target, 
@@ -60,19 +154,19 @@ namespace libqimg::Effects::Blur {
         MTEXEC_PARAMS
     ) {
 
-        FMAT canvas = FMAT(target.canvasSize());
+        MatrixArena arena;
+        FMAT canvas = arena.acquire(target.canvasSize());
 
         for(int i = 0; i < target.count(); i++) {
-            Convolution::convolute(source[i], canvas, Point(radiusX, 0), 1, [](CONV_KERNFUNC_PARAMS) {
-                return 1.0f;
-            }, edgeMode, true, threadCount, taskName);
-            Convolution::convolute(canvas, target[i], Point(0, radiusY), 1, [](CONV_KERNFUNC_PARAMS) {
-                return 1.0f;
-            }, edgeMode, true, threadCount, taskName);
+            if(source.canvasSize() == target.canvasSize())
+                boxBlurHorizontal(source[i], canvas, radiusX, edgeMode, threadCount, taskName);
+            else
+                Convolution::convolute(source[i], canvas, Point(radiusX, 0), 1, [](CONV_KERNFUNC_PARAMS) {
+                    return 1.0f;
+                }, edgeMode, true, threadCount, taskName);
+            boxBlurVertical(canvas, target[i], radiusY, edgeMode, threadCount, taskName);
         }
 
-        canvas.dispose();
-
     }
 
     void boxBlur(
@@ -82,9 +176,8 @@ namespace libqimg::Effects::Blur {
         TileMode::TileMode edgeMode = TileMode::clamp,
         MTEXEC_PARAMS
     ) {
-        FMC cache = FMC::copy(source);
-        boxBlur(cache, source, radiusX, radiusY, edgeMode, threadCount, taskName);
-        cache.dispose();
+        // Every channel is read completely before its vertical pass writes, no copy is needed
+        boxBlur(source, source, radiusX, radiusY, edgeMode, threadCount, taskName);
     }
 
 }
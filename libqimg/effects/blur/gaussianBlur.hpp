@@ -1,4 +1,3 @@
-
 //  Copyright 2021 Isoheptane
 //  Filename    : gaussianBlur.hpp
 //  Purpose     : Gaussian Blur
@@ -8,11 +7,15 @@
 #define _LIBQIMG_FX_GAUSSIANBLUR_HPP_
 
 #include <cstring>
+#include <cmath>
+#include <complex>
+#include <vector>
 
 #include "libqimg_math.hpp"
 #include "../../fmat.hpp"
 #include "../../fmc.hpp"
 #include "../../multiThread.hpp"
+#include "../../matrixPool.hpp"
 #include "../convolution.hpp"
 
 namespace libqimg::Effects::Blur {
@@ -21,90 +24,279 @@ namespace libqimg::Effects::Blur {
         Gaussian Blur: exp(-x^2)
     */
     float gaussianBlurEdge = 2.0f;
+    // Radius from which an axis is blurred by the recursive filter instead of a direct convolution
+    int gaussianRecursiveRadius = 24;
+    // Row count processed by a single task in the recursive horizontal pass
+    const int GAUSSIAN_ROW_GRAIN = 16;
+    // Column count processed together in the recursive vertical pass
+    const int GAUSSIAN_COLUMN_GRAIN = 32;
+
+    // Standard deviation of the kernel exp(-gaussianBlurEdge * x^2 / (radius + 0.5))
+    inline float gaussianSigma(int radius) {
+        return sqrtf(((float)radius + 0.5f) / (2.0f * gaussianBlurEdge));
+    }
+
+    // Return true if the axis of radius will be blurred by the recursive filter
+    inline bool gaussianRecursive(int radius) {
+        float sigma = gaussianSigma(radius);
+        // The direct kernel is cut at radius, it only looks like a gaussian if the cut is far enough
+        return radius >= gaussianRecursiveRadius && sigma >= 0.5f && (float)radius >= sigma * 3.0f;
+    }
+
+    // Write the 2 * radius + 1 gaussian weights from -radius to taps, return their sum
+    inline float gaussianTaps(float* taps, int radius) {
+        float sum = 0.0f;
+        for(int offset = -radius; offset <= radius; offset++) {
+            taps[offset + radius] = expf(-gaussianBlurEdge * (float)offset * (float)offset / ((float)radius + 0.5f));
+            sum += taps[offset + radius];
+        }
+        return sum;
+    }
+
+    // Gaussian Kernel along one axis
+    Convolution::Kernel gaussianKernel(int radius, bool vertical) {
+        auto kernel = vertical ? Convolution::Kernel(0, radius) : Convolution::Kernel(radius, 0);
+        std::vector<float> taps(radius * 2 + 1);
+        gaussianTaps(taps.data(), radius);
+        for(int offset = -radius; offset <= radius; offset++) {
+            if(vertical) kernel(0, offset) = taps[offset + radius];
+            else kernel(offset, 0) = taps[offset + radius];
+        }
+        return kernel;
+    }
+
+    /*
+        Recursive Gaussian (van Vliet, Young & Verbeek, 1998)
+        The cost of a pixel does not depend on the radius.
+        The poles are scaled until the variance of the impulse response is exactly sigma^2,
+        so the result has the same sigma as gaussianKernel.
+    */
+
+    struct RecursiveGaussian {
+        // w[n] = B * x[n] + b1 * w[n - 1] + b2 * w[n - 2] + b3 * w[n - 3]
+        float B, b1, b2, b3;
+        // Pixels read outside the line so the edge mode is respected
+        int padding;
+
+        // Poles of the third order filter designed for sigma = 2
+        inline static const std::complex<double> poles[3] = {
+            { 1.41650, 1.00829 }, { 1.41650, -1.00829 }, { 1.86543, 0.0 }
+        };
+
+        RecursiveGaussian(float sigma) {
+            // Variance of the forward and the backward pass grows with the scale of the poles
+            double low = 0.0, high = sigma * 2.0 + 2.0;
+            for(int i = 0; i < 48; i++) {
+                double scale = (low + high) * 0.5;
+                if(variance(scale) < (double)sigma * sigma) low = scale;
+                else high = scale;
+            }
+            // Expand (1 - z^-1 / d1)(1 - z^-1 / d2)(1 - z^-1 / d3) into the feedback coefficients
+            std::complex<double> a[4] = { 1.0, 0.0, 0.0, 0.0 };
+            for(int k = 0; k < 3; k++) {
+                std::complex<double> d = std::pow(poles[k], 1.0 / ((low + high) * 0.5));
+                for(int i = k + 1; i >= 1; i--)
+                    a[i] -= a[i - 1] / d;
+            }
+            b1 = (float)-a[1].real(), b2 = (float)-a[2].real(), b3 = (float)-a[3].real();
+            B = (float)(1.0 + a[1].real() + a[2].real() + a[3].real());
+            padding = (int)ceilf(sigma * 5.0f) + 3;
+        }
+
+        // Variance of the forward and the backward pass together with the poles raised to 1 / scale
+        static double variance(double scale) {
+            double sum = 0.0;
+            for(int k = 0; k < 3; k++) {
+                std::complex<double> d = std::pow(poles[k], 1.0 / scale);
+                sum += (2.0 * d / ((d - 1.0) * (d - 1.0))).real();
+            }
+            return sum;
+        }
+
+        // Filter lanes interleaved lines of length in place, element n of a lane is data[n * lanes + lane].
+        void filter(float* data, int length, int lanes) const {
+            // Forward, the state before the line is the steady state of the first element
+            for(int n = 0; n < length; n++) {
+                float* w = data + (size_t)n * lanes;
+                const float* w1 = n >= 1 ? w - lanes : data;
+                const float* w2 = n >= 2 ? w - lanes * 2 : data;
+                const float* w3 = n >= 3 ? w - lanes * 3 : data;
+                for(int lane = 0; lane < lanes; lane++)
+                    w[lane] = B * w[lane] + b1 * w1[lane] + b2 * w2[lane] + b3 * w3[lane];
+            }
+            // Backward, the state after the line is the steady state of the last element
+            const float* last = data + (size_t)(length - 1) * lanes;
+            for(int n = length - 1; n >= 0; n--) {
+                float* v = data + (size_t)n * lanes;
+                const float* v1 = n + 1 < length ? v + lanes : last;
+                const float* v2 = n + 2 < length ? v + lanes * 2 : last;
+                const float* v3 = n + 3 < length ? v + lanes * 3 : last;
+                for(int lane = 0; lane < lanes; lane++)
+                    v[lane] = B * v[lane] + b1 * v1[lane] + b2 * v2[lane] + b3 * v3[lane];
+            }
+        }
+    };
+
+    // Recursive gaussian along rows, source and target must have the same size
+    void gaussianBlurRecursiveHorizontal(
+        FMAT& source,
+        FMAT& target,
+        int radius,
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        MTEXEC_PARAMS
+    ) {
+        RecursiveGaussian filter = RecursiveGaussian(gaussianSigma(radius));
+        int width = source.width(), height = source.height(), padding = filter.padding;
+        int taskCount = (height + GAUSSIAN_ROW_GRAIN - 1) / GAUSSIAN_ROW_GRAIN;
+
+        // A padded line for every participant
+        MatrixArena arena;
+        FMAT scratch = arena.acquire(Point(width + padding * 2, MultiThread::maxParticipants(threadCount)));
+
+        MultiThread::parallelFor(taskCount, [&](int task) {
+            float* line = scratch.rowPtr(MultiThread::currentSlot());
+            for(int y = task * GAUSSIAN_ROW_GRAIN; y < math::min((task + 1) * GAUSSIAN_ROW_GRAIN, height); y++) {
+                for(int x = -padding; x < 0; x++)
+                    line[x + padding] = source.pixelAccess(x, y, edgeMode);
+                memcpy(&line[padding], source.rowPtr(y), sizeof(float) * width);
+                for(int x = width; x < width + padding; x++)
+                    line[x + padding] = source.pixelAccess(x, y, edgeMode);
+                filter.filter(line, width + padding * 2, 1);
+                memcpy(target.rowPtr(y), &line[padding], sizeof(float) * width);
+            }
+        }, threadCount);
+    }
+
+    // Recursive gaussian along columns, source and target must have the same size
+    void gaussianBlurRecursiveVertical(
+        FMAT& source,
+        FMAT& target,
+        int radius,
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        MTEXEC_PARAMS
+    ) {
+        RecursiveGaussian filter = RecursiveGaussian(gaussianSigma(radius));
+        int width = source.width(), height = source.height(), padding = filter.padding;
+        int taskCount = (width + GAUSSIAN_COLUMN_GRAIN - 1) / GAUSSIAN_COLUMN_GRAIN;
+
+        // A padded band for every participant
+        MatrixArena arena;
+        FMAT scratch = arena.acquire(Point((height + padding * 2) * GAUSSIAN_COLUMN_GRAIN, MultiThread::maxParticipants(threadCount)));
+
+        // Columns of a band are filtered together, one row of the band at a time
+        MultiThread::parallelFor(taskCount, [&](int task) {
+            int begin = task * GAUSSIAN_COLUMN_GRAIN;
+            int lanes = math::min(begin + GAUSSIAN_COLUMN_GRAIN, width) - begin;
+            float* block = scratch.rowPtr(MultiThread::currentSlot());
+            for(int y = -padding; y < height + padding; y++) {
+                float* line = block + (size_t)(y + padding) * lanes;
+                if(y >= 0 && y < height)
+                    memcpy(line, source.rowPtr(y) + begin, sizeof(float) * lanes);
+                else
+                    for(int lane = 0; lane < lanes; lane++)
+                        line[lane] = source.pixelAccess(begin + lane, y, edgeMode);
+            }
+            filter.filter(block, height + padding * 2, lanes);
+            for(int y = 0; y < height; y++)
+                memcpy(target.rowPtr(y) + begin, block + (size_t)(y + padding) * lanes, sizeof(float) * lanes);
+        }, threadCount);
+    }
+
+    // Gaussian blur along rows, the direct or the recursive path is chosen from the radius
+    void gaussianBlurHorizontal(
+        FMAT& source,
+        FMAT& target,
+        int radius,
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        MTEXEC_PARAMS
+    ) {
+        if(gaussianRecursive(radius) && source.canvasSize() == target.canvasSize()) {
+            gaussianBlurRecursiveHorizontal(source, target, radius, edgeMode, threadCount, taskName);
+            return;
+        }
+        // A one dimensional kernel always takes the direct path, its taps are borrowed instead of allocated
+        MatrixArena arena;
+        float* taps = arena.acquire(Point(radius * 2 + 1, 1)).rowPtr(0);
+        float weight = gaussianTaps(taps, radius);
+        Convolution::convoluteTaps(source, target, taps, Point(radius, 0), weight, edgeMode, true, threadCount, taskName);
+    }
+
+    // Gaussian blur along columns, the direct or the recursive path is chosen from the radius
+    void gaussianBlurVertical(
+        FMAT& source,
+        FMAT& target,
+        int radius,
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        MTEXEC_PARAMS
+    ) {
+        if(gaussianRecursive(radius) && source.canvasSize() == target.canvasSize()) {
+            gaussianBlurRecursiveVertical(source, target, radius, edgeMode, threadCount, taskName);
+            return;
+        }
+        MatrixArena arena;
+        float* taps = arena.acquire(Point(radius * 2 + 1, 1)).rowPtr(0);
+        float weight = gaussianTaps(taps, radius);
+        Convolution::convoluteTaps(source, target, taps, Point(0, radius), weight, edgeMode, true, threadCount, taskName);
+    }
+
     // Gaussian Blur
     void gaussianBlur(
-        FMAT& source, 
-        FMAT& target, 
-        int radiusX, 
-        int radiusY, 
+        FMAT& source,
+        FMAT& target,
+        int radiusX,
+        int radiusY,
         TileMode::TileMode edgeMode = TileMode::clamp,
         MTEXEC_PARAMS
     ) {
-        // Create canvas for process image cache
-        FMAT canvas = FMAT(target.canvasSize());
+        // Borrow canvas for process image cache
+        MatrixArena arena;
+        FMAT canvas = arena.acquire(target.canvasSize());
         // X Axis Convolution
-        {
-            auto kernelX = Convolution::Kernel(radiusX, 0);
-            for(int offset = -radiusX; offset <= radiusX; offset++)
-                kernelX(offset, 0) = expf(-gaussianBlurEdge * (float)offset * (float)offset / ((float)radiusX + 0.5f));
-            Convolution::convolute(source, canvas, kernelX, edgeMode, true, threadCount, taskName);
-            kernelX.dispose();
-        }
+        gaussianBlurHorizontal(source, canvas, radiusX, edgeMode, threadCount, taskName);
         // Y Axis Convolution
-        {
-            auto kernelY = Convolution::Kernel(0, radiusY);
-            for(int offset = -radiusY; offset <= radiusY; offset++)
-                kernelY(0, offset) = expf(-gaussianBlurEdge * (float)offset * (float)offset / ((float)radiusY + 0.5f));
-            Convolution::convolute(canvas, target, kernelY, edgeMode, true, threadCount, taskName);
-            kernelY.dispose();
-        }
-        // Clear cache
-        canvas.dispose();
+        gaussianBlurVertical(canvas, target, radiusY, edgeMode, threadCount, taskName);
     }
     // Gaussian Blur
     void gaussianBlur(
-        FMAT& source, 
-        int radiusX, 
-        int radiusY, 
+        FMAT& source,
+        int radiusX,
+        int radiusY,
         TileMode::TileMode edgeMode = TileMode::clamp,
         MTEXEC_PARAMS
     ) {
-        FMAT cache = FMAT::copy(source);
-        gaussianBlur(cache, source, radiusX, radiusY, edgeMode, threadCount, taskName);
-        cache.dispose();
+        // Source is read completely before the vertical pass writes, no copy is needed
+        gaussianBlur(source, source, radiusX, radiusY, edgeMode, threadCount, taskName);
     }
 
     // Gaussian Blur
     void gaussianBlur(
-        FMC& source, 
-        FMC& target, 
-        int radiusX, 
-        int radiusY, 
+        FMC& source,
+        FMC& target,
+        int radiusX,
+        int radiusY,
         TileMode::TileMode edgeMode = TileMode::clamp,
         MTEXEC_PARAMS
     ) {
-        // Create canvas for process image cache
-        FMAT canvas = FMAT(target.canvasSize());
-        // Precompute Kernel
-        auto kernelX = Convolution::Kernel(radiusX, 0);
-        for(int offset = -radiusX; offset <= radiusX; offset++)
-                kernelX(offset, 0) = expf(-gaussianBlurEdge * (float)offset * (float)offset / ((float)radiusX + 0.5f));
-        auto kernelY = Convolution::Kernel(0, radiusY);
-            for(int offset = -radiusY; offset <= radiusY; offset++)
-                kernelY(0, offset) = expf(-gaussianBlurEdge * (float)offset * (float)offset / ((float)radiusY + 0.5f));
-
+        // Borrow canvas for process image cache
+        MatrixArena arena;
+        FMAT canvas = arena.acquire(target.canvasSize());
         for(int i = 0; i < target.count(); i++) {
-            Convolution::convolute(source[i], canvas, kernelX, edgeMode, true, threadCount, taskName);
-            Convolution::convolute(canvas, target[i], kernelY, edgeMode, true, threadCount, taskName);
+            gaussianBlurHorizontal(source[i], canvas, radiusX, edgeMode, threadCount, taskName);
+            gaussianBlurVertical(canvas, target[i], radiusY, edgeMode, threadCount, taskName);
         }
-        // Clear Cache
-        kernelX.dispose();
-        kernelY.dispose();
-        canvas.dispose();
     }
     // Gaussian Blur
     void gaussianBlur(
-        FMC& source, 
-        int radiusX, 
-        int radiusY, 
+        FMC& source,
+        int radiusX,
+        int radiusY,
         TileMode::TileMode edgeMode = TileMode::clamp,
         MTEXEC_PARAMS
     ) {
-        FMC cache = FMC::copy(source);
-        gaussianBlur(cache, source, radiusX, radiusY, edgeMode, threadCount, taskName);
-        cache.dispose();
+        // Every channel is read completely before its vertical pass writes, no copy is needed
+        gaussianBlur(source, source, radiusX, radiusY, edgeMode, threadCount, taskName);
     }
 
 }
 
-#endif
\ No newline at end of file
+#endif
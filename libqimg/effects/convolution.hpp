@@ -8,23 +8,163 @@
 #define _LIBQIMG_FX_CONVOLUTION_HPP_
 
 #include <cstring>
+#include <vector>
+#include <algorithm>
+#include <mutex>
+#include <map>
+#include <memory>
 
 #include "libqimg_math.hpp"
 #include "../fmat.hpp"
 #include "../fmc.hpp"
 #include "../multiThread.hpp"
+#include "../fft.hpp"
+#include "../simd.hpp"
+#include "../matrixPool.hpp"
+
+namespace libqimg::Effects::Convolution::Strategy {
+
+    // Convolution strategy selection
+    enum Strategy {
+        // Every tap of the 2D kernel per pixel
+        direct = 0,
+        // A row pass and a column pass of a rank-1 kernel
+        separable = 1,
+        // A sum of row and column passes, one for every rank-1 term
+        lowRank = 2,
+        // Overlap-save blocks in the frequency domain
+        fft = 3
+    };
+
+}
 
 namespace libqimg::Effects::Convolution {
 
+    // Singular values below this fraction of the largest one are dropped from the decomposition
+    float kernelRankTolerance = 1e-5f;
+
     /*
         Default Kernel
     */
 
+    // Spectrum of a kernel on FFT blocks of one size, it is not changed once built
+    struct KernelSpectrum {
+        FFT::Plan plan;
+        // Laid out like FFT::forwardReal2D
+        std::vector<FFT::Complex> data;
+    };
+
     // Convolution Kernel
     struct Kernel {
        private:
+        // Data derived from the weights, shared by the shallow copies of a kernel like the weights.
+        // Threads sharing a const kernel fill it under the mutex of the kernel.
+        struct Cache {
+            std::mutex mutex;
+            // Rank-1 terms: kernel(x, y) = sum of columnFactors[r][y] * rowFactors[r][x]
+            // A zero kernel has no terms, so new kernels start decomposed. Editing through operator() marks them stale,
+            // stale kernels are decomposed again by the first query.
+            bool decomposed = true;
+            int termCount = 0;
+            std::vector<float> rowFactors;
+            std::vector<float> columnFactors;
+            // Spectra of the FFT path by block size, dropped on edit. Callers holding one keep it alive.
+            std::map<int, std::shared_ptr<const KernelSpectrum>> spectra;
+        };
+
         Point radius;
         float* data;
+        std::shared_ptr<Cache> cache = std::make_shared<Cache>();
+
+        // Decompose a stale kernel, threads sharing a const kernel may call it together
+        void ensureDecomposed() const {
+            std::lock_guard<std::mutex> lock(cache->mutex);
+            if(!cache->decomposed) factor();
+        }
+
+        // Transform the kernel on blocks of block, the kernel is flipped so the product is a correlation like the direct path
+        std::shared_ptr<const KernelSpectrum> transform(int block) const {
+            int sx = radius.x * 2 + 1, sy = radius.y * 2 + 1;
+            auto spectrum = std::make_shared<KernelSpectrum>();
+            std::vector<float> flipped((size_t)block * block, 0.0f);
+            std::vector<FFT::Complex> line(block);
+            for(int y = 0; y < sy; y++)
+                for(int x = 0; x < sx; x++)
+                    flipped[(size_t)(sy - 1 - y) * block + (sx - 1 - x)] = data[y * sx + x];
+            spectrum->plan = FFT::Plan(block);
+            spectrum->data.assign((size_t)(block / 2 + 1) * block, FFT::Complex());
+            FFT::forwardReal2D(spectrum->plan, flipped.data(), block, spectrum->data.data(), line.data());
+            return spectrum;
+        }
+
+        // Factor the kernel by a one-sided Jacobi SVD
+        void factor() const {
+            int sx = radius.x * 2 + 1, sy = radius.y * 2 + 1;
+            // Columns of a are the kernel columns, v collects the rotations
+            std::vector<double> a((size_t)sx * sy), v((size_t)sx * sx, 0.0);
+            for(int x = 0; x < sx; x++) {
+                for(int y = 0; y < sy; y++)
+                    a[(size_t)x * sy + y] = data[y * sx + x];
+                v[(size_t)x * sx + x] = 1.0;
+            }
+            for(int sweep = 0; sweep < 60; sweep++) {
+                bool rotated = false;
+                for(int p = 0; p < sx - 1; p++)
+                    for(int q = p + 1; q < sx; q++) {
+                        double* ap = &a[(size_t)p * sy];
+                        double* aq = &a[(size_t)q * sy];
+                        double alpha = 0.0, beta = 0.0, gamma = 0.0;
+                        for(int y = 0; y < sy; y++) {
+                            alpha += ap[y] * ap[y];
+                            beta += aq[y] * aq[y];
+                            gamma += ap[y] * aq[y];
+                        }
+                        if(fabs(gamma) <= 1e-15 * sqrt(alpha * beta) || gamma == 0.0) continue;
+                        rotated = true;
+                        double zeta = (beta - alpha) / (2.0 * gamma);
+                        double t = (zeta >= 0.0 ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+                        double c = 1.0 / sqrt(1.0 + t * t), s = c * t;
+                        for(int y = 0; y < sy; y++) {
+                            double np = c * ap[y] - s * aq[y];
+                            aq[y] = s * ap[y] + c * aq[y];
+                            ap[y] = np;
+                        }
+                        double* vp = &v[(size_t)p * sx];
+                        double* vq = &v[(size_t)q * sx];
+                        for(int x = 0; x < sx; x++) {
+                            double np = c * vp[x] - s * vq[x];
+                            vq[x] = s * vp[x] + c * vq[x];
+                            vp[x] = np;
+                        }
+                    }
+                if(!rotated) break;
+            }
+            // Column norms are the singular values, take the terms from the largest one
+            std::vector<double> sigma(sx);
+            std::vector<int> order(sx);
+            for(int x = 0; x < sx; x++) {
+                double norm = 0.0;
+                for(int y = 0; y < sy; y++)
+                    norm += a[(size_t)x * sy + y] * a[(size_t)x * sy + y];
+                sigma[x] = sqrt(norm);
+                order[x] = x;
+            }
+            std::sort(order.begin(), order.end(), [&sigma](int i, int j) { return sigma[i] > sigma[j]; });
+            cache->termCount = 0;
+            cache->rowFactors.clear();
+            cache->columnFactors.clear();
+            for(int i = 0; i < sx; i++) {
+                int term = order[i];
+                if(sigma[term] <= 0.0 || sigma[term] < sigma[order[0]] * kernelRankTolerance) break;
+                // a = U * S, so a column already holds the scaled left vector
+                for(int y = 0; y < sy; y++)
+                    cache->columnFactors.push_back((float)a[(size_t)term * sy + y]);
+                for(int x = 0; x < sx; x++)
+                    cache->rowFactors.push_back((float)v[(size_t)term * sx + x]);
+                cache->termCount++;
+            }
+            cache->decomposed = true;
+        }
        public:
         
         Kernel(Point radius):radius(radius) {
@@ -50,11 +190,13 @@ namespace libqimg::Effects::Convolution {
             
             radius = Point(sx / 2, sy / 2);
             data = new float[sx * sy];
+            for(int i = 0; i < sx * sy; i++)
+                data[i] = 0.0f;
 
             for(int y = 0; y < mat.height(); y++)
                 for(int x = 0; x < mat.width(); x++)
                     data[y * sx + x] = mat.pixelAccess(x, y);
-            
+            factor();
         }
 
         Point size() const { return radius; }
@@ -64,6 +206,8 @@ namespace libqimg::Effects::Convolution {
         }
 
         float& operator()(int x, int y) {
+            cache->decomposed = false;
+            cache->spectra.clear();
             return data[(y + radius.y) * (radius.x * 2 + 1) + (x + radius.x)];
         }
 
@@ -79,10 +223,105 @@ namespace libqimg::Effects::Convolution {
             return this->access(pt.x, pt.y);
         }
 
+        // Factor the kernel into rank-1 terms again. Call it after editing the weights through operator(),
+        // otherwise the first convolution using the kernel does it.
+        void decompose() {
+            std::lock_guard<std::mutex> lock(cache->mutex);
+            factor();
+        }
+
+        // Return the weights row after row from the left up corner, (2 * size().x + 1) x (2 * size().y + 1)
+        const float* weights() const { return data; }
+
+        // Return the spectrum of the flipped kernel on FFT blocks of block x block with the plan of the transform.
+        // It is computed once per block size and kept until the kernel is edited, the returned one stays valid after that.
+        std::shared_ptr<const KernelSpectrum> spectrum(int block) const {
+            std::lock_guard<std::mutex> lock(cache->mutex);
+            auto& entry = cache->spectra[block];
+            if(!entry)
+                entry = transform(block);
+            return entry;
+        }
+
+        // Return the sum of all weights
+        float weight() const {
+            float sum = 0.0f;
+            for(int i = 0; i < (radius.x * 2 + 1) * (radius.y * 2 + 1); i++)
+                sum += data[i];
+            return sum;
+        }
+
+        // Return the count of rank-1 terms needed to rebuild the kernel
+        int rank() const {
+            ensureDecomposed();
+            return cache->termCount;
+        }
+
+        // Return the horizontal factor of a rank-1 term, indexed from -size().x to size().x
+        const float* rowFactor(int term) const {
+            ensureDecomposed();
+            return &cache->rowFactors[(size_t)term * (radius.x * 2 + 1) + radius.x];
+        }
+
+        // Return the vertical factor of a rank-1 term, indexed from -size().y to size().y
+        const float* columnFactor(int term) const {
+            ensureDecomposed();
+            return &cache->columnFactors[(size_t)term * (radius.y * 2 + 1) + radius.y];
+        }
+
+        // Return the strategy convolute will use for this kernel
+        Strategy::Strategy strategy() const;
+
     };
 
-    // Image matrix convolution
-    void convolute(
+    // Copy count pixels of row y of source from x = begin as float, pixels outside the canvas follow the edge mode
+    template <typename T>
+    inline void gatherRow(const Matrix<T>& source, float* line, int y, int begin, int count, TileMode::TileMode edgeMode) {
+        int inner0 = math::clamp(-begin, 0, count);
+        int inner1 = math::clamp(source.width() - begin, inner0, count);
+        if(y < 0 || y >= source.height())
+            inner1 = inner0;
+        for(int i = 0; i < inner0; i++)
+            line[i] = source.pixelAccess(begin + i, y, edgeMode);
+        if(inner1 > inner0)
+            loadElements(line + inner0, source.rowPtr(y) + begin + inner0, inner1 - inner0);
+        for(int i = inner1; i < count; i++)
+            line[i] = source.pixelAccess(begin + i, y, edgeMode);
+    }
+
+    /*
+        FFT Convolution
+    */
+
+    // Tap count from which convolute uses the FFT path for kernels at least FFT_CONVOLUTION_MIN_SIDE wide and high
+    int fftConvolutionThreshold = 256;
+    const int FFT_CONVOLUTION_MIN_SIDE = 9;
+    const int FFT_CONVOLUTION_MIN_BLOCK = 64;
+
+    // Return true if the kernel is large enough for the FFT path
+    inline bool fftPreferred(const Kernel& kernel) {
+        int sx = kernel.size().x * 2 + 1, sy = kernel.size().y * 2 + 1;
+        return sx >= FFT_CONVOLUTION_MIN_SIDE && sy >= FFT_CONVOLUTION_MIN_SIDE && sx * sy >= fftConvolutionThreshold;
+    }
+
+    Strategy::Strategy Kernel::strategy() const {
+        int sx = radius.x * 2 + 1, sy = radius.y * 2 + 1;
+        // One dimensional kernels are already a single pass
+        if(sx > 1 && sy > 1) {
+            int terms = rank();
+            // Passes need terms * (sx + sy) taps per pixel, and take a canvas per pass
+            if(terms == 1)
+                return Strategy::separable;
+            if(terms > 1 && terms * (sx + sy) * 2 <= sx * sy)
+                return Strategy::lowRank;
+        }
+        if(fftPreferred(*this))
+            return Strategy::fft;
+        return Strategy::direct;
+    }
+
+    // Image matrix convolution by overlap-save FFT blocks, matches the direct path up to float rounding
+    void convoluteFFT(
         FMAT& source, 
         FMAT& target, 
         const Kernel& kernel, 
@@ -90,42 +329,287 @@ namespace libqimg::Effects::Convolution {
         bool average = true,
         MTEXEC_PARAMS
     ) {
-        auto function = 
-            [&source, &kernel, &edgeMode, average]
-            (FMAT_PARAMETERIZED_FOREACH_PARAMS) {
-
-                float sum = 0.0f, weight = 0.0f;
-                for(int dx = -kernel.size().x; dx <= kernel.size().x; dx++)
-                    for(int dy = -kernel.size().y; dy <= kernel.size().y; dy++) {
-                        float cw = kernel.access(dx, dy);
-                        sum += source(current.x + dx, current.y + dy) * cw;
-                        weight += kernel.access(dx, dy);
-                    }
-                if(average)
-                    matrix(current) = sum / weight;
+        Point radius = kernel.size();
+        int sx = radius.x * 2 + 1, sy = radius.y * 2 + 1;
+        int block = FFT::nextPowerOfTwo(math::max(math::max(sx, sy) * 2, FFT_CONVOLUTION_MIN_BLOCK));
+        size_t spectrumLength = (size_t)(block / 2 + 1) * block;
+        // Output pixels produced by one block
+        Point valid = Point(block - sx + 1, block - sy + 1);
+        // Held for the whole call, edits or other block sizes do not free it
+        std::shared_ptr<const KernelSpectrum> kernelSpectrum = kernel.spectrum(block);
+        const FFT::Plan& plan = kernelSpectrum->plan;
+        float scale = 1.0f / ((float)block * (float)block);
+        if(average) scale /= kernel.weight();
+
+        // Every participant gets a row of scratch: the input block, its spectrum and a line of the transform
+        MatrixArena arena;
+        FMAT scratch = arena.acquire(Point(block * block + (int)spectrumLength * 2 + block * 2,
+            MultiThread::maxParticipants(threadCount)));
+
+        int columns = (target.width() + valid.x - 1) / valid.x;
+        int rows = (target.height() + valid.y - 1) / valid.y;
+        MultiThread::parallelFor(columns * rows, [&](int task) {
+            Point origin = Point((task % columns) * valid.x, (task / columns) * valid.y);
+            float* input = scratch.rowPtr(MultiThread::currentSlot());
+            FFT::Complex* spectrum = (FFT::Complex*)(input + (size_t)block * block);
+            FFT::Complex* line = spectrum + spectrumLength;
+            // Gather the block around the outputs, pixels outside the canvas follow the edge mode
+            for(int j = 0; j < block; j++)
+                gatherRow(source, input + (size_t)j * block, origin.y - radius.y + j, origin.x - radius.x, block, edgeMode);
+            FFT::forwardReal2D(plan, input, block, spectrum, line);
+            for(size_t i = 0; i < spectrumLength; i++)
+                spectrum[i] *= kernelSpectrum->data[i];
+            FFT::inverseReal2D(plan, spectrum, input, block, line);
+            // Output (u, v) of the block is at (u + sx - 1, v + sy - 1) of the circular result
+            int width = math::min(valid.x, target.width() - origin.x);
+            int height = math::min(valid.y, target.height() - origin.y);
+            for(int v = 0; v < height; v++) {
+                const float* result = input + (size_t)(v + sy - 1) * block + sx - 1;
+                float* output = target.rowPtr(origin.y + v) + origin.x;
+                for(int u = 0; u < width; u++)
+                    output[u] = result[u] * scale;
+            }
+        }, threadCount);
+    }
+
+    // Image matrix convolution by sx x sy taps, row after row from the left up corner, centered on radius
+    // Whole row segments are accumulated by the SIMD row kernels. Interior segments read source in place,
+    // border segments read rows gathered with the edge mode applied.
+    void convoluteTaps(
+        FMAT& source, 
+        FMAT& target, 
+        const float* taps, 
+        Point radius, 
+        float weight, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        bool average = true,
+        MTEXEC_PARAMS
+    ) {
+        int sx = radius.x * 2 + 1, sy = radius.y * 2 + 1;
+
+        // Gathered border rows of every participant, a border segment is never wider than the target
+        MatrixArena arena;
+        FMAT scratch = arena.acquire(Point((target.width() + sx - 1) * sy, MultiThread::maxParticipants(threadCount)));
+
+        // corner is the left up tap of the first output, lines are lineStride floats apart
+        auto accumulate = [taps, sx, sy, weight, average](float* output, const float* corner, size_t lineStride, int count) {
+            if(sx == 1)
+                SIMD::columnTaps(output, corner, lineStride, count, taps, sy);
+            else
+                for(int t = 0; t < sy; t++)
+                    SIMD::rowTaps(output, corner + (size_t)t * lineStride, count, taps + (size_t)t * sx, sx, t > 0);
+            if(average)
+                for(int i = 0; i < count; i++)
+                    output[i] /= weight;
+        };
+
+        MultiThread::multiThreadExecuteSplit(target, radius, source.canvasSize() - radius,
+            [&source, &radius, &accumulate](FMAT_SPLIT_PARAMS) {
+                accumulate(row + begin, source.rowPtr(y - radius.y) + begin - radius.x, source.stride(), end - begin);
+            },
+            [&source, &radius, &accumulate, &scratch, sx, sy, edgeMode](FMAT_SPLIT_PARAMS) {
+                int lineLength = end - begin + sx - 1;
+                float* lines = scratch.rowPtr(MultiThread::currentSlot());
+                for(int t = 0; t < sy; t++)
+                    gatherRow(source, lines + (size_t)t * lineLength, y - radius.y + t, begin - radius.x, lineLength, edgeMode);
+                accumulate(row + begin, lines, lineLength, end - begin);
+            },
+        taskName, threadCount);
+    }
+
+    // Image matrix convolution, every tap of kernel per pixel
+    void convoluteDirect(
+        FMAT& source, 
+        FMAT& target, 
+        const Kernel& kernel, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        bool average = true,
+        MTEXEC_PARAMS
+    ) {
+        convoluteTaps(source, target, kernel.weights(), kernel.size(), kernel.weight(), edgeMode, average, threadCount, taskName);
+    }
+
+    // Image matrix convolution of matrices of other element types, every tap of kernel per pixel
+    // Source rows are converted to float lines as they are gathered, outputs are accumulated in float and converted on store.
+    template <typename Source, typename Target>
+    void convoluteDirect(
+        Matrix<Source>& source, 
+        Matrix<Target>& target, 
+        const Kernel& kernel, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        bool average = true,
+        MTEXEC_PARAMS
+    ) {
+        Point radius = kernel.size();
+        int sx = radius.x * 2 + 1, sy = radius.y * 2 + 1;
+        const float* taps = kernel.weights();
+        float weight = kernel.weight();
+
+        // Gathered rows and the float outputs of every participant
+        MatrixArena arena;
+        FMAT scratch = arena.acquire(Point((target.width() + sx - 1) * sy + target.width(), MultiThread::maxParticipants(threadCount)));
+
+        MultiThread::multiThreadExecuteSpan(target, {},
+            [&source, &radius, &scratch, taps, sx, sy, weight, average, edgeMode](Target* row, const float* const*, int y, int begin, int end) {
+                int count = end - begin;
+                int lineLength = count + sx - 1;
+                float* lines = scratch.rowPtr(MultiThread::currentSlot());
+                float* output = lines + (size_t)lineLength * sy;
+                for(int t = 0; t < sy; t++)
+                    gatherRow(source, lines + (size_t)t * lineLength, y - radius.y + t, begin - radius.x, lineLength, edgeMode);
+                if(sx == 1)
+                    SIMD::columnTaps(output, lines, lineLength, count, taps, sy);
                 else
-                    matrix(current) = sum;
-            };
-        
-        if(!MultiThread::multiThreadExecute(target, function, taskName, threadCount))
-            target.parameterizedForeach(function);
+                    for(int t = 0; t < sy; t++)
+                        SIMD::rowTaps(output, lines + (size_t)t * lineLength, count, taps + (size_t)t * sx, sx, t > 0);
+                if(average)
+                    for(int i = 0; i < count; i++)
+                        output[i] /= weight;
+                storeElements(row + begin, output, count);
+            },
+        taskName, threadCount);
+    }
+
+    // Image matrix convolution by a row pass and a column pass for every rank-1 term of kernel
+    // The row pass covers the source rows the column pass reads, radius.y above and below the target,
+    // so the edge mode is applied at the source boundary whatever the size of the target.
+    void convoluteTerms(
+        FMAT& source, 
+        FMAT& target, 
+        const Kernel& kernel, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        bool average = true,
+        MTEXEC_PARAMS
+    ) {
+        Point radius = kernel.size();
+        int sx = radius.x * 2 + 1, sy = radius.y * 2 + 1;
+        int terms = kernel.rank();
+        MatrixArena arena;
+        // Row y of rows is the row pass of source row y - radius.y
+        FMAT rows = arena.acquire(Point(target.width(), target.height() + radius.y * 2));
+        FMAT partial = arena.acquire(terms > 1 ? target.canvasSize() : Point(0, 0));
+        // Gathered source rows of every participant
+        FMAT scratch = arena.acquire(Point(target.width() + sx - 1, MultiThread::maxParticipants(threadCount)));
+
+        // The factors are read in place as the taps of 1D passes
+        for(int term = 0; term < terms; term++) {
+            const float* rowTaps = kernel.rowFactor(term) - radius.x;
+            const float* columnTaps = kernel.columnFactor(term) - radius.y;
+            MultiThread::multiThreadExecuteSpan(rows, {}, [&source, &scratch, radius, rowTaps, sx, edgeMode](FMAT_SPAN_PARAMS) {
+                int sourceY = y - radius.y;
+                int count = end - begin;
+                if(sourceY >= 0 && sourceY < source.height() && begin >= radius.x && end + radius.x <= source.width()) {
+                    SIMD::rowTaps(row + begin, source.rowPtr(sourceY) + begin - radius.x, count, rowTaps, sx, false);
+                    return;
+                }
+                float* line = scratch.rowPtr(MultiThread::currentSlot());
+                gatherRow(source, line, sourceY, begin - radius.x, count + sx - 1, edgeMode);
+                SIMD::rowTaps(row + begin, line, count, rowTaps, sx, false);
+            }, taskName, threadCount);
+            // Output row y reads rows y to y + 2 * radius.y
+            FMAT& output = term == 0 ? target : partial;
+            MultiThread::multiThreadExecuteSpan(output, {}, [&rows, columnTaps, sy](FMAT_SPAN_PARAMS) {
+                SIMD::columnTaps(row + begin, rows.rowPtr(y) + begin, rows.stride(), end - begin, columnTaps, sy);
+            }, taskName, threadCount);
+            if(term == 0)
+                continue;
+            MultiThread::multiThreadExecuteSpan(target, { &partial }, [](FMAT_SPAN_PARAMS) {
+                const float* input = sources[0];
+                for(int x = begin; x < end; x++)
+                    row[x] += input[x];
+            }, taskName, threadCount);
+        }
+        if(average) {
+            float scale = 1.0f / kernel.weight();
+            MultiThread::multiThreadExecuteSpan(target, {}, [scale](FMAT_SPAN_PARAMS) {
+                for(int x = begin; x < end; x++)
+                    row[x] *= scale;
+            }, taskName, threadCount);
+        }
+    }
+
+    // Image matrix convolution
+    // The strategy is chosen from the kernel and returned: separable and low rank kernels run as 1D passes,
+    // large dense kernels run in the frequency domain.
+    Strategy::Strategy convolute(
+        FMAT& source, 
+        FMAT& target, 
+        const Kernel& kernel, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        bool average = true,
+        MTEXEC_PARAMS
+    ) {
+        Strategy::Strategy strategy = kernel.strategy();
+        switch (strategy) {
+            case Strategy::separable:
+            case Strategy::lowRank:
+                convoluteTerms(source, target, kernel, edgeMode, average, threadCount, taskName);
+                break;
+            case Strategy::fft:
+                convoluteFFT(source, target, kernel, edgeMode, average, threadCount, taskName);
+                break;
+            default:
+                convoluteDirect(source, target, kernel, edgeMode, average, threadCount, taskName);
+                break;
+        }
+        return strategy;
+    }
+    // Image matrix convolution of matrices of other element types
+    // Direct kernels convert in the row kernels, the other strategies run on float copies of source and target.
+    template <typename Source, typename Target>
+    Strategy::Strategy convolute(
+        Matrix<Source>& source, 
+        Matrix<Target>& target, 
+        const Kernel& kernel, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        bool average = true,
+        MTEXEC_PARAMS
+    ) {
+        Strategy::Strategy strategy = kernel.strategy();
+        if(strategy == Strategy::direct) {
+            convoluteDirect(source, target, kernel, edgeMode, average, threadCount, taskName);
+            return strategy;
+        }
+        MatrixArena arena;
+        FMAT input = arena.acquire(source.canvasSize());
+        FMAT output = arena.acquire(target.canvasSize());
+        input.copyContent(source);
+        convolute(input, output, kernel, edgeMode, average, threadCount, taskName);
+        target.copyContent(output);
+        return strategy;
     }
     // Self effect
     // Image matrix convolution
-    void convolute(
+    Strategy::Strategy convolute(
         FMAT& source, 
         const Kernel& kernel, 
         TileMode::TileMode edgeMode = TileMode::clamp,
         bool average = true,
         MTEXEC_PARAMS
     ) {
-        FMAT cache = FMAT::copy(source);
-        convolute(cache, source, kernel, edgeMode, average, threadCount, taskName);
-        cache.dispose();
+        MatrixArena arena;
+        FMAT cache = arena.copy(source);
+        return convolute(cache, source, kernel, edgeMode, average, threadCount, taskName);
+    }
+
+    // Self effect
+    // Image matrix convolution of a matrix of another element type
+    template <typename T>
+    Strategy::Strategy convolute(
+        Matrix<T>& source, 
+        const Kernel& kernel, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        bool average = true,
+        MTEXEC_PARAMS
+    ) {
+        MatrixArena arena;
+        FMAT cache = arena.acquire(source.canvasSize());
+        cache.copyContent(source);
+        return convolute(cache, source, kernel, edgeMode, average, threadCount, taskName);
     }
 
     // Image matrix convolution
-    void convolute(
+    Strategy::Strategy convolute(
         FMC& source, 
         FMC& target, 
         const Kernel& kernel, 
@@ -135,26 +619,43 @@ namespace libqimg::Effects::Convolution {
     ) {
         for(int i = 0; i < target.count(); i++)
             convolute(source[i], target[i], kernel, edgeMode, average, threadCount, taskName);
+        return kernel.strategy();
     }
     // Self effect
     // Image matrix convolution
-    void convolute(
+    Strategy::Strategy convolute(
         FMC& source,  
         const Kernel& kernel, 
         TileMode::TileMode edgeMode = TileMode::clamp,
         bool average = true,
         MTEXEC_PARAMS
     ) {
-        FMAT cache = FMAT(source.canvasSize());
+        MatrixArena arena;
+        FMAT cache = arena.acquire(source.canvasSize());
         for(int i = 0; i < source.count(); i++) {
             cache.copyContent(source[i]);
             convolute(cache, source[i], kernel, edgeMode, average, threadCount, taskName);
         }
-        cache.dispose();
+        return kernel.strategy();
+    }
+
+    // Image matrix convolution of collections of other element types
+    template <typename Source, typename Target>
+    Strategy::Strategy convolute(
+        MatrixCollection<Source>& source, 
+        MatrixCollection<Target>& target, 
+        const Kernel& kernel, 
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        bool average = true,
+        MTEXEC_PARAMS
+    ) {
+        for(int i = 0; i < target.count(); i++)
+            convolute(source[i], target[i], kernel, edgeMode, average, threadCount, taskName);
+        return kernel.strategy();
     }
 
     // Image matrix convolution
-    void convolute(
+    Strategy::Strategy convolute(
         FMC& source, 
         FMC& target, 
         const FMAT& kernel, 
@@ -165,7 +666,9 @@ namespace libqimg::Effects::Convolution {
         Kernel realKernel = Kernel(kernel);
         for(int i = 0; i < target.count(); i++)
             convolute(source[i], target[i], realKernel, edgeMode, average, threadCount, taskName);
+        Strategy::Strategy strategy = realKernel.strategy();
         realKernel.dispose();
+        return strategy;
     }
 
     #define CONV_KERNFUNC_PARAMS int dx, int dy
@@ -182,25 +685,33 @@ namespace libqimg::Effects::Convolution {
         bool average = true,
         MTEXEC_PARAMS
     ) {
-        auto function = 
-            [&source, &size, step, &kernel, &edgeMode, average]
-            (FMAT_PARAMETERIZED_FOREACH_PARAMS) {
-
-                float sum = 0.0f, weight = 0.0f;
-                for(int dy = -size.y; dy <= size.y; dy += step)
-                    for(int dx = -size.x; dx <= size.x; dx += step) {
-                        float cw = kernel(dx, dy);
-                        sum += source.pixelAccess(current.x + dx, current.y + dy, edgeMode) * cw;
-                        weight += kernel(dx, dy);
+        float weight = 0.0f;
+        for(int dy = -size.y; dy <= size.y; dy += step)
+            for(int dx = -size.x; dx <= size.x; dx += step)
+                weight += kernel(dx, dy);
+
+        MultiThread::multiThreadExecuteSplit(target, size, source.canvasSize() - size,
+            [&source, &size, step, &kernel, weight, average](FMAT_SPLIT_PARAMS) {
+                for(int x = begin; x < end; x++) {
+                    float sum = 0.0f;
+                    for(int dy = -size.y; dy <= size.y; dy += step) {
+                        const float* line = source.rowPtr(y + dy) + x;
+                        for(int dx = -size.x; dx <= size.x; dx += step)
+                            sum += line[dx] * kernel(dx, dy);
                     }
-                if(average)
-                    matrix(current) = sum / weight;
-                else
-                    matrix(current) = sum;
-            };
-        
-        if(!MultiThread::multiThreadExecute(target, function, taskName, threadCount))
-            target.parameterizedForeach(function);
+                    row[x] = average ? sum / weight : sum;
+                }
+            },
+            [&source, &size, step, &kernel, &edgeMode, weight, average](FMAT_SPLIT_PARAMS) {
+                for(int x = begin; x < end; x++) {
+                    float sum = 0.0f;
+                    for(int dy = -size.y; dy <= size.y; dy += step)
+                        for(int dx = -size.x; dx <= size.x; dx += step)
+                            sum += source.pixelAccess(x + dx, y + dy, edgeMode) * kernel(dx, dy);
+                    row[x] = average ? sum / weight : sum;
+                }
+            },
+        taskName, threadCount);
     }
         // Self effect
     // Image matrix convolution
@@ -214,9 +725,9 @@ namespace libqimg::Effects::Convolution {
         bool average = true,
         MTEXEC_PARAMS
     ) {
-        FMAT cache = FMAT::copy(source);
+        MatrixArena arena;
+        FMAT cache = arena.copy(source);
         convolute(cache, source, size, step, kernel, edgeMode, average, threadCount, taskName);
-        cache.dispose();
     }
 
     // Image convolution using kernel function
@@ -246,12 +757,12 @@ namespace libqimg::Effects::Convolution {
         bool average = true,
         MTEXEC_PARAMS
     ) {
-        FMAT cache = FMAT(source.canvasSize());
+        MatrixArena arena;
+        FMAT cache = arena.acquire(source.canvasSize());
         for(int ch = 0; ch < source.count(); ch++) {
             cache.copyContent(source[ch]);
             convolute(cache, source[ch], size, step, kernel, edgeMode, average, threadCount, taskName);
         }
-        cache.dispose();
     }
 
     /*
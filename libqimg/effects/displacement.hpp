@@ -12,7 +12,10 @@
 #include "libqimg_math.hpp"
 #include "../fmat.hpp"
 #include "../fmc.hpp"
+#include "../fmci.hpp"
+#include "../fmcn.hpp"
 #include "../multiThread.hpp"
+#include "../matrixPool.hpp"
 
 namespace libqimg::Effects {
 
@@ -28,17 +31,38 @@ namespace libqimg::Effects {
         MTEXEC_PARAMS
     ) {
 
-        auto function = 
-            [&source, &offsetX, &offsetY, &scale, &edgeMode, &sampleMode]
-            (FMAT_MTEXEC_PARAMS) {
-                reference = source.sample(PointF(
-                    (float)current.x + 0.5f + (offsetX(current) * scale.x),
-                    (float)current.y + 0.5f + (offsetY(current) * scale.y)),
-                sampleMode, edgeMode);
-            };
+        // Modes are resolved once, the per pixel sample has no mode switch left
+        TileMode::dispatch(edgeMode, [&](auto tileMode) {
+            SampleMode::dispatch(sampleMode, [&](auto sampleMode) {
+                constexpr TileMode::TileMode tile = decltype(tileMode)::value;
+                constexpr SampleMode::SampleMode mode = decltype(sampleMode)::value;
 
-        if(!MultiThread::multiThreadExecute(target, function, taskName, threadCount))
-            target.parameterizedForeach(function);
+                if(offsetX.canvasSize() == target.canvasSize() && offsetY.canvasSize() == target.canvasSize()) {
+                    MultiThread::multiThreadExecuteSpan(target, { &offsetX, &offsetY }, 
+                        [&source, scale]
+                        (FMAT_SPAN_PARAMS) {
+                        const float* dx = sources[0];
+                        const float* dy = sources[1];
+                        for(int x = begin; x < end; x++)
+                            row[x] = source.sample<mode, tile>(PointF(
+                                (float)x + 0.5f + (dx[x] * scale.x),
+                                (float)y + 0.5f + (dy[x] * scale.y)));
+                    }, taskName, threadCount);
+                    return;
+                }
+
+                auto function = 
+                    [&source, &offsetX, &offsetY, &scale]
+                    (FMAT_MTEXEC_PARAMS) {
+                        reference = source.sample<mode, tile>(PointF(
+                            (float)current.x + 0.5f + (offsetX(current) * scale.x),
+                            (float)current.y + 0.5f + (offsetY(current) * scale.y)));
+                    };
+
+                if(!MultiThread::multiThreadExecute(target, function, taskName, threadCount))
+                    target.parameterizedForeach(function);
+            });
+        });
 
     }
     // Self effect
@@ -51,12 +75,80 @@ namespace libqimg::Effects {
         SampleMode::SampleMode sampleMode = SampleMode::bilinear,
         MTEXEC_PARAMS
     ) {
-        FMAT cache = FMAT::copy(source);
+        MatrixArena arena;
+        FMAT cache = arena.copy(source);
         displace(cache, offsetX, offsetY, source, scale, edgeMode, sampleMode, threadCount, taskName);
-        cache.dispose();
     }
+    // Sample position of a displaced pixel, shared by every channel
+    struct DisplaceTap {
+        // Offsets of the left up, right up, left down and right down pixels from the first pixel of a channel
+        int lu, ru, ld, rd;
+        // Bilinear weights
+        float tx, ty;
+        // Bit i is set if pixel i is outside of an empty edge
+        int outside;
+    };
+
+    // Pixels displaced together, the taps of a batch are reused for every channel
+    const int DISPLACE_BATCH = 64;
+
+    // Locate the pixels sampled at pt, same positions and weights as FMAT::sample
+    template <SampleMode::SampleMode sampleMode, TileMode::TileMode tileMode>
+    inline DisplaceTap displaceTap(PointF pt, Point size, int stride) {
+        DisplaceTap tap;
+        int x0, y0;
+        if constexpr (sampleMode == SampleMode::nearest) {
+            x0 = (int)floorf(pt.x);
+            y0 = (int)floorf(pt.y);
+            tap.tx = tap.ty = 0.0f;
+        } else {
+            float fx = floorf(pt.x - 0.5f), fy = floorf(pt.y - 0.5f);
+            x0 = (int)fx;
+            y0 = (int)fy;
+            tap.tx = pt.x - 0.5f - fx;
+            tap.ty = pt.y - 0.5f - fy;
+        }
+        int x1 = x0 + 1, y1 = y0 + 1;
+        tap.outside = 0;
+        if(x0 < 0 || y0 < 0 || x1 >= size.x || y1 >= size.y) {
+            if constexpr (tileMode == TileMode::empty) {
+                bool outX0 = x0 < 0 || x0 >= size.x, outX1 = x1 < 0 || x1 >= size.x;
+                bool outY0 = y0 < 0 || y0 >= size.y, outY1 = y1 < 0 || y1 >= size.y;
+                tap.outside = (outX0 || outY0) | (outX1 || outY0) << 1 | (outX0 || outY1) << 2 | (outX1 || outY1) << 3;
+            }
+            x0 = TileMode::resolve<tileMode>(x0, size.x);
+            x1 = TileMode::resolve<tileMode>(x1, size.x);
+            y0 = TileMode::resolve<tileMode>(y0, size.y);
+            y1 = TileMode::resolve<tileMode>(y1, size.y);
+        }
+        tap.lu = stride * y0 + x0;
+        tap.ru = stride * y0 + x1;
+        tap.ld = stride * y1 + x0;
+        tap.rd = stride * y1 + x1;
+        return tap;
+    }
+
+    // Sample a channel with a tap
+    template <SampleMode::SampleMode sampleMode, TileMode::TileMode tileMode>
+    inline float displaceApply(const float* channel, const DisplaceTap& tap) {
+        if constexpr (tileMode == TileMode::empty) {
+            float lu = tap.outside & 1 ? 0.0f : channel[tap.lu];
+            if constexpr (sampleMode == SampleMode::nearest)
+                return lu;
+            else
+                return SampleMode::bilinearSample(lu,
+                    tap.outside & 2 ? 0.0f : channel[tap.ru],
+                    tap.outside & 4 ? 0.0f : channel[tap.ld],
+                    tap.outside & 8 ? 0.0f : channel[tap.rd], PointF(tap.tx, tap.ty));
+        } else if constexpr (sampleMode == SampleMode::nearest)
+            return channel[tap.lu];
+        else
+            return SampleMode::bilinearSample(
+                channel[tap.lu], channel[tap.ru], channel[tap.ld], channel[tap.rd], PointF(tap.tx, tap.ty));
+    }
+
     // Use FMAT as offset
-    // Use offset to resample matrix
+    // Use offset to resample matrix, offsets and weights are computed once for all channels
     void displace(
         FMC& source,
         FMAT& offsetX, FMAT& offsetY,
@@ -66,11 +158,50 @@ namespace libqimg::Effects {
         SampleMode::SampleMode sampleMode = SampleMode::bilinear,
         MTEXEC_PARAMS
     ) {
-        for(int i = 0; i < target.count(); i++)
-            displace(source[i], offsetX, offsetY, target[i], scale, edgeMode, sampleMode, threadCount, taskName);
+        int channelCount = math::min((int)source.count(), (int)target.count());
+        bool fusible = channelCount > 0 &&
+            offsetX.canvasSize() == target.canvasSize() && offsetY.canvasSize() == target.canvasSize();
+        // Taps are shared only if every source channel has the same row stride
+        for(int i = 1; i < channelCount && fusible; i++)
+            fusible = source[i].stride() == source[0].stride() && source[i].canvasSize() == source[0].canvasSize();
+        if(!fusible) {
+            for(int i = 0; i < target.count(); i++)
+                displace(source[i], offsetX, offsetY, target[i], scale, edgeMode, sampleMode, threadCount, taskName);
+            return;
+        }
+
+        Point sourceSize = source[0].canvasSize();
+        int sourceStride = source[0].stride();
+        TileMode::dispatch(edgeMode, [&](auto tileMode) {
+            SampleMode::dispatch(sampleMode, [&](auto sampleMode) {
+                constexpr TileMode::TileMode tile = decltype(tileMode)::value;
+                constexpr SampleMode::SampleMode mode = decltype(sampleMode)::value;
+
+                MultiThread::multiThreadExecuteSpan(target, { &offsetX, &offsetY }, 
+                    [&source, &target, channelCount, sourceSize, sourceStride, scale]
+                    (FMC_SPAN_PARAMS) {
+                    DisplaceTap taps[DISPLACE_BATCH];
+                    for(int x0 = begin; x0 < end; x0 += DISPLACE_BATCH) {
+                        int count = math::min(end - x0, DISPLACE_BATCH);
+                        for(int i = 0; i < count; i++) {
+                            int x = x0 + i;
+                            taps[i] = displaceTap<mode, tile>(PointF(
+                                (float)x + 0.5f + (sources[0][x] * scale.x),
+                                (float)y + 0.5f + (sources[1][x] * scale.y)), sourceSize, sourceStride);
+                        }
+                        for(int ch = 0; ch < channelCount; ch++) {
+                            const float* channel = source[ch].rowPtr(0);
+                            float* row = target[ch].rowPtr(y) + x0;
+                            for(int i = 0; i < count; i++)
+                                row[i] = displaceApply<mode, tile>(channel, taps[i]);
+                        }
+                    }
+                }, taskName, threadCount);
+            });
+        });
     }
     // Self effect
-    // Use offset to resample matrix
+    // Use offset to resample matrix, the result is written to a scratch collection which then takes the place of source
     void displace(
         FMC& source,
         FMAT& offsetX, FMAT& offsetY,
@@ -79,13 +210,111 @@ namespace libqimg::Effects {
         SampleMode::SampleMode sampleMode = SampleMode::bilinear,
         MTEXEC_PARAMS
     ) {
-        FMAT cache = FMAT(source.canvasSize());
-        for(int i = 0; i < source.count(); i++) {
-            cache.copyContent(source[i]);
-            displace(cache, offsetX, offsetY, source[i], scale, edgeMode, sampleMode, threadCount, taskName);
-        }
+        FMC cache = FMC(source.canvasSize(), source.count());
+        displace(source, offsetX, offsetY, cache, scale, edgeMode, sampleMode, threadCount, taskName);
+        if(!source.swapContent(cache))
+            source.copyContent(cache);
         cache.dispose();
     }
+    // Interleaved collection, every channel of a pixel is sampled at once
+    // Use offset to resample matrix
+    void displace(
+        FMCI& source,
+        FMAT& offsetX, FMAT& offsetY,
+        FMCI& target,
+        PointF scale = PointF(1.0f, 1.0f),
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        SampleMode::SampleMode sampleMode = SampleMode::bilinear,
+        MTEXEC_PARAMS
+    ) {
+        bool sameSize = offsetX.canvasSize() == target.canvasSize() && offsetY.canvasSize() == target.canvasSize();
+        TileMode::dispatch(edgeMode, [&](auto tileMode) {
+            SampleMode::dispatch(sampleMode, [&](auto sampleMode) {
+                constexpr TileMode::TileMode tile = decltype(tileMode)::value;
+                constexpr SampleMode::SampleMode mode = decltype(sampleMode)::value;
+
+                MultiThread::multiThreadExecuteSpan(target, { &offsetX, &offsetY }, 
+                    [&source, &offsetX, &offsetY, scale, sameSize]
+                    (FMCI_SPAN_PARAMS) {
+                    for(int x = begin; x < end; x++) {
+                        // Offsets of another size are clamped like the FMAT path
+                        float dx = sameSize ? sources[0][x] : offsetX(x, y);
+                        float dy = sameSize ? sources[1][x] : offsetY(x, y);
+                        row[x] = source.sample<mode, tile>(PointF(
+                            (float)x + 0.5f + (dx * scale.x),
+                            (float)y + 0.5f + (dy * scale.y)));
+                    }
+                }, taskName, threadCount);
+            });
+        });
+    }
+    // Fixed channel count collection, the channel loop is unrolled
+    // Use offset to resample matrix, offsets and weights are computed once for all channels
+    template <int N>
+    void displace(
+        FixedMatrixCollection<N>& source,
+        FMAT& offsetX, FMAT& offsetY,
+        FixedMatrixCollection<N>& target,
+        PointF scale = PointF(1.0f, 1.0f),
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        SampleMode::SampleMode sampleMode = SampleMode::bilinear,
+        MTEXEC_PARAMS
+    ) {
+        bool fusible = offsetX.canvasSize() == target.canvasSize() && offsetY.canvasSize() == target.canvasSize();
+        for(int i = 1; i < N && fusible; i++)
+            fusible = source[i].stride() == source[0].stride();
+        if(!fusible) {
+            for(int i = 0; i < N; i++)
+                displace(source[i], offsetX, offsetY, target[i], scale, edgeMode, sampleMode, threadCount, taskName);
+            return;
+        }
+
+        Point sourceSize = source.canvasSize();
+        int sourceStride = source[0].stride();
+        const float* channels[N];
+        for(int ch = 0; ch < N; ch++)
+            channels[ch] = source[ch].rowPtr(0);
+        TileMode::dispatch(edgeMode, [&](auto tileMode) {
+            SampleMode::dispatch(sampleMode, [&](auto sampleMode) {
+                constexpr TileMode::TileMode tile = decltype(tileMode)::value;
+                constexpr SampleMode::SampleMode mode = decltype(sampleMode)::value;
+
+                MultiThread::multiThreadExecuteSpan(target, { &offsetX, &offsetY }, 
+                    [&channels, sourceSize, sourceStride, scale]
+                    (FMCN_SPAN_PARAMS) {
+                    DisplaceTap taps[DISPLACE_BATCH];
+                    for(int x0 = begin; x0 < end; x0 += DISPLACE_BATCH) {
+                        int count = math::min(end - x0, DISPLACE_BATCH);
+                        for(int i = 0; i < count; i++) {
+                            int x = x0 + i;
+                            taps[i] = displaceTap<mode, tile>(PointF(
+                                (float)x + 0.5f + (sources[0][x] * scale.x),
+                                (float)y + 0.5f + (sources[1][x] * scale.y)), sourceSize, sourceStride);
+                        }
+                        for(int ch = 0; ch < N; ch++)
+                            for(int i = 0; i < count; i++)
+                                rows[ch][x0 + i] = displaceApply<mode, tile>(channels[ch], taps[i]);
+                    }
+                }, taskName, threadCount);
+            });
+        });
+    }
+    // Self effect
+    // Use offset to resample matrix, the result is written to a scratch collection which then takes the place of source
+    template <int N>
+    void displace(
+        FixedMatrixCollection<N>& source,
+        FMAT& offsetX, FMAT& offsetY,
+        PointF scale = PointF(1.0f, 1.0f),
+        TileMode::TileMode edgeMode = TileMode::clamp,
+        SampleMode::SampleMode sampleMode = SampleMode::bilinear,
+        MTEXEC_PARAMS
+    ) {
+        FixedMatrixCollection<N> cache = FixedMatrixCollection<N>(source.canvasSize());
+        displace(source, offsetX, offsetY, cache, scale, edgeMode, sampleMode, threadCount, taskName);
+        if(!source.swapContent(cache))
+            source.copyContent(cache);
+    }
     // Each channel has different offset FMAT
     // Use offset to resample matrix
     void displace(
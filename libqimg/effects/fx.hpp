@@ -9,12 +9,14 @@
 
 #include "libqimg_math.hpp"
 
+#include "resample.hpp"
 #include "pointSample.hpp"
 #include "areaSample.hpp"
 #include "valueMap.hpp"
 #include "blend.hpp"
 #include "noise.hpp"
 #include "displacement.hpp"
+#include "remap.hpp"
 #include "convolution.hpp"
 #include "normalMap.hpp"
 
@@ -13,30 +13,39 @@
 #include "../fmat.hpp"
 #include "../fmc.hpp"
 #include "../multiThread.hpp"
+#include "../random.hpp"
 #include "valueMap.hpp"
 
 namespace libqimg::Effects {
 
     // FMAT noise
-    // Create random noise
+    // Create random noise, every pixel only depends on key and its position,
+    // so the result is the same for any thread count.
     void noise(
         FMAT& source, 
         float min,
         float max,
-        int seed,
+        Random::Key key,
         MTEXEC_PARAMS
     ) {
 
-        srand(seed);
-        auto function = [&min, &max](FMAT_MTEXEC_PARAMS) {
-            reference = math::lerp(min, max, (float)rand() / (float)RAND_MAX);
-        };
-        
-        if(!MultiThread::multiThreadExecute(source, function, taskName, threadCount))
-            source.parameterizedForeach(function);
+        MultiThread::multiThreadExecuteSpan(source, {}, [min, max, key](FMAT_SPAN_PARAMS) {
+            Random::fillUniform(row + begin, begin, y, end - begin, key, min, max);
+        }, taskName, threadCount);
 
     }
-    // Generate noise on each channel
+    // FMAT noise
+    // Create random noise
+    void noise(
+        FMAT& source, 
+        float min,
+        float max,
+        int seed,
+        MTEXEC_PARAMS
+    ) {
+        noise(source, min, max, Random::Key(seed), threadCount, taskName);
+    }
+    // Generate noise on each channel, the channel index is the stream of the key
     // Create random noise
     void noise(
         FMC& source, 
@@ -47,7 +56,7 @@ namespace libqimg::Effects {
         MTEXEC_PARAMS
     ) {
         for(int i = 0; i < source.count(); i++)
-            noise(source[i], min, max, singleColor ? seed : seed + i, threadCount, taskName);
+            noise(source[i], min, max, Random::Key(seed, singleColor ? 0 : i), threadCount, taskName);
     }
     
 }
@@ -24,6 +24,39 @@ namespace libqimg::Effects::Normal {
         MTEXEC_PARAMS
     ) {
         
+        if(xmat.canvasSize() == source.canvasSize() && 
+           ymat.canvasSize() == source.canvasSize() && 
+           zmat.canvasSize() == source.canvasSize()) {
+            // Interior pixels read their four neighbours directly, the border clamps them
+            MultiThread::multiThreadExecuteSplit(xmat, Point(1, 1), source.canvasSize() - Point(1, 1),
+                [&source, &ymat, &zmat, scale]
+                (FMAT_SPLIT_PARAMS) {
+
+                const float* center = source.rowPtr(y);
+                const float* up = source.rowPtr(y - 1);
+                const float* down = source.rowPtr(y + 1);
+                float* yrow = ymat.rowPtr(y);
+                float* zrow = zmat.rowPtr(y);
+                for(int x = begin; x < end; x++) {
+                    row[x] = 0.5f + (center[x - 1] - center[x + 1]) * scale;
+                    yrow[x] = 0.5f - (up[x] - down[x]) * scale;
+                    zrow[x] = 1.0f;
+                }
+            },
+                [&source, &ymat, &zmat, scale]
+                (FMAT_SPLIT_PARAMS) {
+
+                float* yrow = ymat.rowPtr(y);
+                float* zrow = zmat.rowPtr(y);
+                for(int x = begin; x < end; x++) {
+                    row[x] = 0.5f + (source.pixelAccess(x - 1, y) - source.pixelAccess(x + 1, y)) * scale;
+                    yrow[x] = 0.5f - (source.pixelAccess(x, y - 1) - source.pixelAccess(x, y + 1)) * scale;
+                    zrow[x] = 1.0f;
+                }
+            }, taskName, threadCount);
+            return;
+        }
+
         auto function = 
             [&xmat, &ymat, &zmat, scale]
             (FMAT_MTEXEC_PARAMS) {
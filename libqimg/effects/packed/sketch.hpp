@@ -16,10 +16,14 @@
 #include "../convolution.hpp"
 #include "../valueMap.hpp"
 #include "../blend.hpp"
+#include "../noise.hpp"
 #include "../blur/gaussianBlur.hpp"
 
 namespace libqimg::Effects::Sketch {
 
+    // Seed of the pencil stroke noise
+    int sketchNoiseSeed = 0;
+
     void sketch(
         FMAT& source, 
         FMAT& target,
@@ -49,9 +53,7 @@ namespace libqimg::Effects::Sketch {
             return bottom - top;
         });
 
-        valueMap(canvasBlured, [](VALUEMAP_PARAMS) {
-            return 0.0f + ((float)rand() / (float)RAND_MAX) * 0.2f;
-        });
+        noise(canvasBlured, 0.0f, 0.2f, sketchNoiseSeed, threadCount, taskName);
 
         Blur::gaussianBlur(canvasBlured, 200, 5);
 
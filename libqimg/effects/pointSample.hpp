@@ -12,38 +12,49 @@
 #include "libqimg_math.hpp"
 #include "../fmat.hpp"
 #include "../fmc.hpp"
+#include "../fmci.hpp"
 #include "../multiThread.hpp"
+#include "resample.hpp"
 
 namespace libqimg::Effects::Sample {
 
     // FMAT Point Resample
-    // Interpolated Point Sample. MultiThreading is not recommended for resample effects.
+    // Interpolated Point Sample, resampled in two separable passes. Use Resampler to resize the same sizes many times.
     void pointSample(
         FMAT& source, 
         FMAT& target, 
         SampleMode::SampleMode sampleMode, 
         MTEXEC_PARAMS
     ) {
-        auto function = [&source, &sampleMode](FMAT_MTEXEC_PARAMS) {
-            matrix(current.x, current.y) = 
-                source.sample(source.positionFloat(matrix.coordinate(current)), sampleMode);
-        };
-
-        if(!MultiThread::multiThreadExecute(target, function, taskName, threadCount))
-            target.parameterizedForeach(function); 
+        Resampler(source.canvasSize(), target.canvasSize(), sampleMode).apply(source, target, threadCount, taskName);
     }
     // FMC Point Resample
-    // Interpolated Point Sample. MultiThreading is not recommended for resample effects.
+    // Interpolated Point Sample, weight tables are shared by channels.
     void pointSample(
         FMC& source, 
         FMC& target, 
         SampleMode::SampleMode sampleMode, 
         MTEXEC_PARAMS
     ) {
-        for(int i = 0; i < target.count(); i++)
-            pointSample(source[i], target[i], sampleMode, threadCount, taskName);
+        Resampler(source.canvasSize(), target.canvasSize(), sampleMode).apply(source, target, threadCount, taskName);
+    }
+    // FMCI Point Resample
+    // Every channel of a pixel is sampled at once, bicubic and lanczos are sampled as bilinear.
+    void pointSample(
+        FMCI& source, 
+        FMCI& target, 
+        SampleMode::SampleMode sampleMode, 
+        MTEXEC_PARAMS
+    ) {
+        SampleMode::dispatch(sampleMode, [&](auto sampleMode) {
+            constexpr SampleMode::SampleMode mode = decltype(sampleMode)::value;
+            MultiThread::multiThreadExecuteSpan(target, {}, [&source, &target](FMCI_SPAN_PARAMS) {
+                for(int x = begin; x < end; x++)
+                    row[x] = source.sample<mode, TileMode::clamp>(source.positionFloat(target.coordinate(Point(x, y))));
+            }, taskName, threadCount);
+        });
     }
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,267 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : remap.hpp
+//  Purpose     : Precomputed displacement
+//  License     : MIT License
+
+#ifndef _LIBQIMG_FX_REMAP_HPP_
+#define _LIBQIMG_FX_REMAP_HPP_
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#include "libqimg_math.hpp"
+#include "../fmat.hpp"
+#include "../fmc.hpp"
+#include "../multiThread.hpp"
+#include "displacement.hpp"
+
+namespace libqimg::Effects {
+
+    /*
+        Remap Table
+        Built once from the offset maps, the scale, the edge mode and the sample mode of a displace call,
+        applying it to a source of the same layout gives the same result as displace.
+        Nearest tables hold the int32 offset of the sampled pixel per target pixel, -1 outside of an empty edge.
+        Bilinear tables hold one record per target pixel:
+            offset          int32       left up pixel, from the first pixel of the source
+            weights         2 x float   bilinear weights
+            or 2 x uint8    weights in 1/256 steps, if quantized
+            flags           uint8       bit 0 to 1: step code to the right up pixel, bit 2 to 3: to the left down pixel,
+                                        bit 4 to 7: pixels outside of an empty edge
+        Tile modes resolve each axis on its own, so a step to the next pixel is only ever one of
+        +1, 0 (clamped or reflected in place), -1 (mirrored) or 1 - size (wrapped), times the stride for rows.
+        A record is 16 bytes with float weights and 8 bytes with quantized ones.
+    */
+
+    // Steps of a quantized weight
+    const float REMAP_WEIGHT_STEPS = 256.0f;
+
+    // Bilinear record with float weights
+    struct RemapEntry {
+        int32_t offset;
+        float tx, ty;
+        uint8_t flags;
+    };
+
+    // Bilinear record with weights in 1 / REMAP_WEIGHT_STEPS
+    struct RemapQuantizedEntry {
+        int32_t offset;
+        uint8_t tx, ty;
+        uint8_t flags;
+    };
+
+    class Remap {
+
+      private:
+        Point size;
+        Point sourceSize;
+        int sourceStride = 0;
+        TileMode::TileMode edgeMode = TileMode::clamp;
+        SampleMode::SampleMode sampleMode = SampleMode::nearest;
+        bool quantizedWeights = false;
+        // Step of every step code, to the right up pixel and to the left down pixel
+        int32_t stepsX[4] = {};
+        int32_t stepsY[4] = {};
+        std::vector<int32_t> offsets;
+        std::vector<RemapEntry> entries;
+        std::vector<RemapQuantizedEntry> quantizedEntries;
+
+        // Fill the step codes of the source layout
+        void setupSteps() {
+            int32_t stepX[4] = { 1, 0, -1, 1 - sourceSize.x };
+            int32_t stepY[4] = { sourceStride, 0, -sourceStride, (1 - sourceSize.y) * sourceStride };
+            memcpy(stepsX, stepX, sizeof(stepsX));
+            memcpy(stepsY, stepY, sizeof(stepsY));
+        }
+
+        // Return the code of a step of unit to the next pixel, anything else is a wrap
+        inline static int stepCode(int step, int unit) {
+            return step == unit ? 0 : step == 0 ? 1 : step == -unit ? 2 : 3;
+        }
+
+        // Store the tap of target pixel index
+        template <SampleMode::SampleMode mode, TileMode::TileMode tile>
+        inline void store(size_t index, const DisplaceTap& tap) {
+            if constexpr (mode == SampleMode::nearest) {
+                if constexpr (tile == TileMode::empty)
+                    offsets[index] = tap.outside & 1 ? -1 : tap.lu;
+                else
+                    offsets[index] = tap.lu;
+            } else {
+                uint8_t flags = (uint8_t)(stepCode(tap.ru - tap.lu, 1) | stepCode(tap.ld - tap.lu, sourceStride) << 2 | tap.outside << 4);
+                if(quantizedWeights) {
+                    RemapQuantizedEntry& entry = quantizedEntries[index];
+                    entry.offset = tap.lu;
+                    entry.tx = (uint8_t)math::min((int)(tap.tx * REMAP_WEIGHT_STEPS + 0.5f), 255);
+                    entry.ty = (uint8_t)math::min((int)(tap.ty * REMAP_WEIGHT_STEPS + 0.5f), 255);
+                    entry.flags = flags;
+                } else {
+                    RemapEntry& entry = entries[index];
+                    entry.offset = tap.lu;
+                    entry.tx = tap.tx;
+                    entry.ty = tap.ty;
+                    entry.flags = flags;
+                }
+            }
+        }
+
+        // Sample channel at target pixel index, the pixels are read like DisplaceTap
+        template <SampleMode::SampleMode mode, TileMode::TileMode tile, bool quantize>
+        inline float gather(const float* channel, size_t index) const {
+            if constexpr (mode == SampleMode::nearest) {
+                int offset = offsets[index];
+                if constexpr (tile == TileMode::empty)
+                    return offset < 0 ? 0.0f : channel[offset];
+                else
+                    return channel[offset];
+            } else {
+                int lu, flags;
+                PointF t;
+                if constexpr (quantize) {
+                    const RemapQuantizedEntry& entry = quantizedEntries[index];
+                    lu = entry.offset, flags = entry.flags;
+                    t = PointF(entry.tx / REMAP_WEIGHT_STEPS, entry.ty / REMAP_WEIGHT_STEPS);
+                } else {
+                    const RemapEntry& entry = entries[index];
+                    lu = entry.offset, flags = entry.flags;
+                    t = PointF(entry.tx, entry.ty);
+                }
+                int ru = lu + stepsX[flags & 3];
+                int ld = lu + stepsY[flags >> 2 & 3];
+                int rd = ru + stepsY[flags >> 2 & 3];
+                if constexpr (tile == TileMode::empty) {
+                    int mask = flags >> 4;
+                    return SampleMode::bilinearSample(
+                        mask & 1 ? 0.0f : channel[lu], mask & 2 ? 0.0f : channel[ru],
+                        mask & 4 ? 0.0f : channel[ld], mask & 8 ? 0.0f : channel[rd], t);
+                } else
+                    return SampleMode::bilinearSample(channel[lu], channel[ru], channel[ld], channel[rd], t);
+            }
+        }
+
+        // Call function with the modes of this table as compile-time constants
+        template <class Function>
+        inline void dispatch(Function&& function) const {
+            TileMode::dispatch(edgeMode, [&](auto tileMode) {
+                SampleMode::dispatch(sampleMode, [&](auto sampleMode) {
+                    if(quantizedWeights)
+                        function(tileMode, sampleMode, std::true_type());
+                    else
+                        function(tileMode, sampleMode, std::false_type());
+                });
+            });
+        }
+
+      public:
+
+        Remap() {}
+
+        // Build the table of displace(source, offsetX, offsetY, target, scale, edgeMode, sampleMode) for sources laid out like source.
+        // Offset maps have to be of the target size.
+        Remap(
+            FMAT& source,
+            FMAT& offsetX, FMAT& offsetY,
+            PointF scale = PointF(1.0f, 1.0f),
+            TileMode::TileMode edgeMode = TileMode::clamp,
+            SampleMode::SampleMode sampleMode = SampleMode::bilinear,
+            bool quantize = false,
+            MTEXEC_PARAMS
+        ):size(offsetX.canvasSize()), sourceSize(source.canvasSize()), sourceStride(source.stride()),
+          edgeMode(edgeMode), sampleMode(sampleMode), quantizedWeights(quantize) {
+
+            if(offsetY.canvasSize() != size) {
+                size = Point(0, 0);
+                return;
+            }
+            size_t pixels = (size_t)size.x * size.y;
+            setupSteps();
+            dispatch([&](auto tileMode, auto sampleMode, auto) {
+                constexpr TileMode::TileMode tile = decltype(tileMode)::value;
+                constexpr SampleMode::SampleMode mode = decltype(sampleMode)::value;
+                if constexpr (mode == SampleMode::nearest)
+                    offsets.resize(pixels);
+                else if(quantizedWeights)
+                    quantizedEntries.resize(pixels);
+                else
+                    entries.resize(pixels);
+
+                MultiThread::multiThreadExecuteSpan(offsetX, { &offsetX, &offsetY },
+                    [this, scale]
+                    (FMAT_SPAN_PARAMS) {
+                    for(int x = begin; x < end; x++)
+                        store<mode, tile>((size_t)size.x * y + x, displaceTap<mode, tile>(PointF(
+                            (float)x + 0.5f + (sources[0][x] * scale.x),
+                            (float)y + 0.5f + (sources[1][x] * scale.y)), sourceSize, sourceStride));
+                }, taskName, threadCount);
+            });
+        }
+
+        // Free memory
+        void dispose() {
+            std::vector<int32_t>().swap(offsets);
+            std::vector<RemapEntry>().swap(entries);
+            std::vector<RemapQuantizedEntry>().swap(quantizedEntries);
+            size = Point(0, 0);
+        }
+
+        inline Point canvasSize() const { return size; }
+        inline bool quantizedWeight() const { return quantizedWeights; }
+
+        // Return true if source is laid out like the source the table was built for
+        inline bool accepts(const FMAT& source) const {
+            return source.canvasSize() == sourceSize && source.stride() == sourceStride;
+        }
+
+        // Return the memory used by the table in bytes
+        size_t bytes() const {
+            return offsets.size() * sizeof(int32_t) + entries.size() * sizeof(RemapEntry) +
+                quantizedEntries.size() * sizeof(RemapQuantizedEntry);
+        }
+
+        // Resample source into target, return false if source or target does not fit the table
+        bool apply(FMAT& source, FMAT& target, MTEXEC_PARAMS) const {
+            if(!accepts(source) || target.canvasSize() != size || size.x * size.y == 0)
+                return false;
+            dispatch([&](auto tileMode, auto sampleMode, auto quantize) {
+                constexpr TileMode::TileMode tile = decltype(tileMode)::value;
+                constexpr SampleMode::SampleMode mode = decltype(sampleMode)::value;
+                MultiThread::multiThreadExecuteSpan(target, {}, [this, &source](FMAT_SPAN_PARAMS) {
+                    const float* channel = source.rowPtr(0);
+                    size_t index = (size_t)size.x * y;
+                    for(int x = begin; x < end; x++)
+                        row[x] = gather<mode, tile, decltype(quantize)::value>(channel, index + x);
+                }, taskName, threadCount);
+            });
+            return true;
+        }
+
+        // Resample every channel of source into target, the table is read once per pixel for all channels
+        bool apply(FMC& source, FMC& target, MTEXEC_PARAMS) const {
+            int channelCount = math::min((int)source.count(), (int)target.count());
+            for(int ch = 0; ch < channelCount; ch++)
+                if(!accepts(source[ch]) || target[ch].canvasSize() != size)
+                    return false;
+            if(channelCount == 0 || size.x * size.y == 0)
+                return false;
+            dispatch([&](auto tileMode, auto sampleMode, auto quantize) {
+                constexpr TileMode::TileMode tile = decltype(tileMode)::value;
+                constexpr SampleMode::SampleMode mode = decltype(sampleMode)::value;
+                MultiThread::multiThreadExecuteSpan(target, {}, [this, &source, &target, channelCount](FMC_SPAN_PARAMS) {
+                    size_t index = (size_t)size.x * y;
+                    for(int ch = 0; ch < channelCount; ch++) {
+                        const float* channel = source[ch].rowPtr(0);
+                        float* row = target[ch].rowPtr(y);
+                        for(int x = begin; x < end; x++)
+                            row[x] = gather<mode, tile, decltype(quantize)::value>(channel, index + x);
+                    }
+                }, taskName, threadCount);
+            });
+            return true;
+        }
+
+    };
+
+}
+
+#endif
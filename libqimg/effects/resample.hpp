@@ -0,0 +1,189 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : resample.hpp
+//  Purpose     : Separable resize with precomputed weight tables
+//  License     : MIT License
+
+#ifndef _LIBQIMG_FX_RESAMPLE_HPP_
+#define _LIBQIMG_FX_RESAMPLE_HPP_
+
+#include <cstring>
+#include <vector>
+
+#include "libqimg_math.hpp"
+#include "../fmat.hpp"
+#include "../fmc.hpp"
+#include "../multiThread.hpp"
+#include "../simd.hpp"
+#include "../matrixPool.hpp"
+
+namespace libqimg::Effects::Sample {
+
+    /*
+        Separable Resampler
+        Pixel centers map like pointSample: target coordinate -> source position, the edge is clamped.
+        Weights of an axis only depend on the position along it, so they are computed once per column and per row.
+        When an axis shrinks, bicubic and lanczos filters are stretched by sourceSize / targetSize,
+        so every source pixel is still covered and high frequencies do not alias.
+        Rows of the source are first resampled horizontally into a buffer of target width,
+        then every target row is a weighted sum of buffer rows.
+    */
+
+    // Filter taps of every target position along one axis
+    struct ResampleAxis {
+        int taps = 0;
+        // Source index of the first tap, before clamping
+        std::vector<int> first;
+        // taps clamped source indices per position
+        std::vector<int> indices;
+        // taps weights per position
+        std::vector<float> weights;
+
+        ResampleAxis() {}
+
+        ResampleAxis(int sourceSize, int targetSize, SampleMode::SampleMode sampleMode) {
+            taps = SampleMode::filterTaps(sampleMode);
+            // An empty axis has no positions to fill or no pixels to read, the tables stay empty
+            if(sourceSize <= 0 || targetSize <= 0)
+                return;
+            // Filter stretch of a downsize, the support and the taps grow with it
+            float scale = 1.0f;
+            bool stretched = (sampleMode == SampleMode::bicubic || sampleMode == SampleMode::lanczos) && sourceSize > targetSize;
+            if(stretched) {
+                scale = (float)sourceSize / (float)targetSize;
+                taps = 2 * (int)ceilf(taps / 2 * scale);
+            }
+            first.resize(targetSize);
+            indices.resize((size_t)targetSize * taps);
+            weights.resize((size_t)targetSize * taps);
+            for(int i = 0; i < targetSize; i++) {
+                // Same float steps as positionFloat(coordinate(i)) of a point sample
+                float coordinate = math::reverseLerp((float)targetSize / 2.0f, (float)targetSize, (float)i + 0.5f);
+                float position = math::lerp((float)sourceSize / 2.0f, (float)sourceSize, coordinate);
+                int begin;
+                float t;
+                if(sampleMode == SampleMode::nearest) {
+                    begin = (int)floorf(position);
+                    t = 0.0f;
+                } else {
+                    float f = floorf(position - 0.5f);
+                    begin = (int)f - (taps / 2 - 1);
+                    t = position - 0.5f - f;
+                }
+                first[i] = begin;
+                float sum = 0.0f;
+                for(int k = 0; k < taps; k++) {
+                    float weight;
+                    if(taps == 1)
+                        weight = 1.0f;
+                    else if(sampleMode == SampleMode::bilinear)
+                        weight = k == 0 ? 1.0f - t : t;
+                    else
+                        weight = SampleMode::filterWeight(sampleMode, ((float)(k - (taps / 2 - 1)) - t) / scale);
+                    indices[(size_t)i * taps + k] = math::clamp(begin + k, 0, sourceSize - 1);
+                    weights[(size_t)i * taps + k] = weight;
+                    sum += weight;
+                }
+                // Lanczos weights and stretched weights do not sum up to 1
+                if((sampleMode == SampleMode::lanczos || stretched) && sum != 0.0f)
+                    for(int k = 0; k < taps; k++)
+                        weights[(size_t)i * taps + k] /= sum;
+            }
+        }
+    };
+
+    class Resampler {
+
+      private:
+        Point sourceSize, targetSize;
+        ResampleAxis columns, rows;
+        // Source rows read by any target row
+        std::vector<char> rowUsed;
+
+        // Resample rows of source into buffer, buffer has target width and source height
+        void horizontal(FMAT& source, FMAT& buffer, int threadCount, std::string taskName) const {
+            MultiThread::multiThreadExecuteSpan(buffer, {}, [this, &source](FMAT_SPAN_PARAMS) {
+                if(!rowUsed[y]) return;
+                const float* in = source.rowPtr(y);
+                int taps = columns.taps;
+                const int* index = columns.indices.data();
+                const float* weight = columns.weights.data();
+                for(int x = begin; x < end; x++) {
+                    float sum = 0.0f;
+                    for(int k = 0; k < taps; k++)
+                        sum += weight[(size_t)x * taps + k] * in[index[(size_t)x * taps + k]];
+                    row[x] = sum;
+                }
+            }, taskName, threadCount);
+        }
+
+        // Sum buffer rows into target
+        void vertical(FMAT& buffer, FMAT& target, int threadCount, std::string taskName) const {
+            MultiThread::multiThreadExecuteSpan(target, {}, [this, &buffer](FMAT_SPAN_PARAMS) {
+                int taps = rows.taps;
+                const int* index = rows.indices.data() + (size_t)y * taps;
+                const float* weight = rows.weights.data() + (size_t)y * taps;
+                // Taps inside the source are consecutive rows, they are summed by the column kernel
+                if(rows.first[y] >= 0 && rows.first[y] + taps <= sourceSize.y) {
+                    SIMD::columnTaps(row + begin, buffer.rowPtr(index[0]) + begin, buffer.stride(), end - begin, weight, taps);
+                    return;
+                }
+                for(int x = begin; x < end; x++) {
+                    float sum = 0.0f;
+                    for(int k = 0; k < taps; k++)
+                        sum += weight[k] * buffer.rowPtr(index[k])[x];
+                    row[x] = sum;
+                }
+            }, taskName, threadCount);
+        }
+
+      public:
+
+        Resampler() {}
+
+        // Prepare the weight tables of a resize from sourceSize to targetSize
+        // Empty canvases get empty tables, apply() refuses them.
+        Resampler(Point sourceSize, Point targetSize, SampleMode::SampleMode sampleMode):
+            sourceSize(sourceSize), targetSize(targetSize) {
+            if(sourceSize.x <= 0 || sourceSize.y <= 0 || targetSize.x <= 0 || targetSize.y <= 0)
+                return;
+            columns = ResampleAxis(sourceSize.x, targetSize.x, sampleMode);
+            rows = ResampleAxis(sourceSize.y, targetSize.y, sampleMode);
+            rowUsed.assign(sourceSize.y, 0);
+            for(int index : rows.indices)
+                rowUsed[index] = 1;
+        }
+
+        inline Point sourceCanvas() const { return sourceSize; }
+        inline Point targetCanvas() const { return targetSize; }
+
+        // Resize source into target, return false if the sizes do not match the tables
+        bool apply(FMAT& source, FMAT& target, MTEXEC_PARAMS) const {
+            if(source.canvasSize() != sourceSize || target.canvasSize() != targetSize ||
+               sourceSize.x <= 0 || sourceSize.y <= 0 || targetSize.x <= 0 || targetSize.y <= 0)
+                return false;
+            MatrixArena arena;
+            FMAT buffer = arena.acquire(Point(targetSize.x, sourceSize.y));
+            horizontal(source, buffer, threadCount, taskName);
+            vertical(buffer, target, threadCount, taskName);
+            return true;
+        }
+
+        // Resize every channel of source into target, the buffer is shared by channels
+        bool apply(FMC& source, FMC& target, MTEXEC_PARAMS) const {
+            if(source.canvasSize() != sourceSize || target.canvasSize() != targetSize ||
+               sourceSize.x <= 0 || sourceSize.y <= 0 || targetSize.x <= 0 || targetSize.y <= 0)
+                return false;
+            MatrixArena arena;
+            FMAT buffer = arena.acquire(Point(targetSize.x, sourceSize.y));
+            for(int i = 0; i < math::min((int)source.count(), (int)target.count()); i++) {
+                horizontal(source[i], buffer, threadCount, taskName);
+                vertical(buffer, target[i], threadCount, taskName);
+            }
+            return true;
+        }
+
+    };
+
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include "libqimg_math.hpp"
 #include "../fmat.hpp"
 #include "../fmc.hpp"
+#include "../fmcn.hpp"
 #include "../multiThread.hpp"
 
 namespace libqimg::Effects {
@@ -19,16 +20,26 @@ namespace libqimg::Effects {
     #define VALUEMAP_PARAMS float input
     // ValueMap for FMAT
     // Convert every float into another float value, function parameters: (float input)
-    template <class Function>
+    // Matrices of other element types are converted to float and back around converter.
+    template <class Function, typename Source, typename Target>
     void valueMap(
-        FMAT& source, 
-        FMAT& target, 
+        Matrix<Source>& source, 
+        Matrix<Target>& target, 
         const Function& converter,
         MTEXEC_PARAMS
     ) {
         
-        auto function = [&source, &converter](FMAT_MTEXEC_PARAMS) {
-            reference = converter(source(current));
+        if(source.canvasSize() == target.canvasSize()) {
+            MultiThread::multiThreadExecuteSpan(target, {}, [&source, &converter](Target* row, const float* const*, int y, int begin, int end) {
+                const Source* input = source.rowPtr(y);
+                for(int x = begin; x < end; x++)
+                    row[x] = Element<Target>::fromFloat(converter(Element<Source>::toFloat(input[x])));
+            }, taskName, threadCount);
+            return;
+        }
+
+        auto function = [&source, &converter](Target& reference, Point current, Matrix<Target>&) {
+            reference = Element<Target>::fromFloat(converter(source.pixelAccess(current.x, current.y)));
         };
         
         if(!MultiThread::multiThreadExecute(target, function, taskName, threadCount))
@@ -37,9 +48,9 @@ namespace libqimg::Effects {
     }
     // Self effect
     // Convert every float into another float value, function parameters: (float input)
-    template <class Function>
+    template <class Function, typename T>
     void valueMap(
-        FMAT& source, 
+        Matrix<T>& source, 
         const Function& converter,
         MTEXEC_PARAMS
     ) {
@@ -47,10 +58,10 @@ namespace libqimg::Effects {
     }
     // ValueMap for FMC
     // Convert every float into another float value, function parameters: (float& input)
-    template <class Function>
+    template <class Function, typename Source, typename Target>
     void valueMap(
-        FMC& source,
-        FMC& target,
+        MatrixCollection<Source>& source,
+        MatrixCollection<Target>& target,
         const Function& converter,
         MTEXEC_PARAMS
     ) {
@@ -59,15 +70,47 @@ namespace libqimg::Effects {
     }
     // Self effect
     // Convert every float into another float value, function parameters: (float& input)
-    template <class Function>
+    template <class Function, typename T>
     void valueMap(
-        FMC& source,
+        MatrixCollection<T>& source,
         const Function& converter,
         MTEXEC_PARAMS
     ) {
         for(int i = 0; i < source.count(); i++)
             valueMap(source[i], converter, threadCount, taskName);
     }
+    // ValueMap for FMCN, every channel of a row segment is mapped by one task
+    // Convert every float into another float value, function parameters: (float input)
+    template <class Function, int N>
+    void valueMap(
+        FixedMatrixCollection<N>& source,
+        FixedMatrixCollection<N>& target,
+        const Function& converter,
+        MTEXEC_PARAMS
+    ) {
+        if(source.canvasSize() != target.canvasSize()) {
+            for(int i = 0; i < N; i++)
+                valueMap(source[i], target[i], converter, threadCount, taskName);
+            return;
+        }
+        MultiThread::multiThreadExecuteSpan(target, {}, [&source, &converter](FMCN_SPAN_PARAMS) {
+            for(int ch = 0; ch < N; ch++) {
+                const float* input = source[ch].rowPtr(y);
+                for(int x = begin; x < end; x++)
+                    rows[ch][x] = converter(input[x]);
+            }
+        }, taskName, threadCount);
+    }
+    // Self effect
+    // Convert every float into another float value, function parameters: (float input)
+    template <class Function, int N>
+    void valueMap(
+        FixedMatrixCollection<N>& source,
+        const Function& converter,
+        MTEXEC_PARAMS
+    ) {
+        valueMap(source, source, converter, threadCount, taskName);
+    }
     
 }
 
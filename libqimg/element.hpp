@@ -0,0 +1,195 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : element.hpp
+//  Purpose     : Element types of matrices and their conversion to float
+//  License     : MIT License
+
+#ifndef _LIBQIMG_ELEMENT_HPP_
+#define _LIBQIMG_ELEMENT_HPP_
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#include "libqimg_debuglog.hpp"
+#include "simd.hpp"
+
+namespace libqimg::ElementType {
+
+    // Storage type of matrix elements, the value is recorded in typed files
+    enum ElementType {
+        // 32 bit float, values are stored as they are
+        float32 = 0,
+        // 8 bit unsigned, [0, 255] maps to [0, 1]
+        uint8 = 1,
+        // 16 bit unsigned, [0, 65535] maps to [0, 1]
+        uint16 = 2,
+        // IEEE binary16
+        half = 3,
+        // Upper 16 bits of a float
+        bfloat16 = 4
+    };
+
+}
+
+namespace libqimg {
+
+    /*
+        Element Types
+        Effects compute in float. Elements are converted to float when they are read
+        and converted back when they are stored, a row at a time by loadElements and storeElements.
+        Normalized integers clamp to [0, 1] and round to the nearest step,
+        half and bfloat16 round to nearest even.
+    */
+
+    // IEEE binary16, 1 sign 5 exponent 10 mantissa bits
+    struct Half {
+        uint16_t bits = 0;
+
+        Half() {}
+        explicit Half(float value):bits(SIMD::floatToHalfBits(value)) {}
+        explicit operator float() const { return SIMD::halfBitsToFloat(bits); }
+    };
+
+    // bfloat16, 1 sign 8 exponent 7 mantissa bits, the upper half of a float
+    struct BFloat16 {
+        uint16_t bits = 0;
+
+        BFloat16() {}
+        explicit BFloat16(float value) {
+            uint32_t word;
+            memcpy(&word, &value, 4);
+            if((word & 0x7FFFFFFF) > 0x7F800000)
+                bits = (uint16_t)((word >> 16) | 0x40);
+            else
+                bits = (uint16_t)((word + 0x7FFF + ((word >> 16) & 1)) >> 16);
+        }
+        explicit operator float() const {
+            uint32_t word = (uint32_t)bits << 16;
+            float value;
+            memcpy(&value, &word, 4);
+            return value;
+        }
+    };
+
+    // Conversion of a single element, specialized for every element type
+    template <typename T> struct Element;
+
+    template <> struct Element<float> {
+        static constexpr ElementType::ElementType type = ElementType::float32;
+        static inline float toFloat(float value) { return value; }
+        static inline float fromFloat(float value) { return value; }
+    };
+
+    template <> struct Element<uint8_t> {
+        static constexpr ElementType::ElementType type = ElementType::uint8;
+        static inline float toFloat(uint8_t value) { return (float)value * (1.0f / 255.0f); }
+        static inline uint8_t fromFloat(float value) {
+            // NaN fails both tests and becomes 0
+            value = value > 0.0f ? value : 0.0f;
+            value = value < 1.0f ? value : 1.0f;
+            return (uint8_t)(value * 255.0f + 0.5f);
+        }
+    };
+
+    template <> struct Element<uint16_t> {
+        static constexpr ElementType::ElementType type = ElementType::uint16;
+        static inline float toFloat(uint16_t value) { return (float)value * (1.0f / 65535.0f); }
+        static inline uint16_t fromFloat(float value) {
+            value = value > 0.0f ? value : 0.0f;
+            value = value < 1.0f ? value : 1.0f;
+            return (uint16_t)(value * 65535.0f + 0.5f);
+        }
+    };
+
+    template <> struct Element<Half> {
+        static constexpr ElementType::ElementType type = ElementType::half;
+        static inline float toFloat(Half value) { return (float)value; }
+        static inline Half fromFloat(float value) { return Half(value); }
+    };
+
+    template <> struct Element<BFloat16> {
+        static constexpr ElementType::ElementType type = ElementType::bfloat16;
+        static inline float toFloat(BFloat16 value) { return (float)value; }
+        static inline BFloat16 fromFloat(float value) { return BFloat16(value); }
+    };
+
+    // Return the size of an element of type in bytes
+    inline size_t elementSize(ElementType::ElementType type) {
+        switch (type) {
+            case ElementType::uint8:
+                return 1;
+            case ElementType::uint16:
+            case ElementType::half:
+            case ElementType::bfloat16:
+                return 2;
+            default:
+                return 4;
+        }
+    }
+
+    // Return true if type is a known element type
+    inline bool validElementType(int type) {
+        return type >= ElementType::float32 && type <= ElementType::bfloat16;
+    }
+
+    // out[i] = in[i] as float, the loop is simple enough to be vectorized
+    template <typename T>
+    inline void loadElements(float* out, const T* in, int count) {
+        for(int i = 0; i < count; i++)
+            out[i] = Element<T>::toFloat(in[i]);
+    }
+
+    template <>
+    inline void loadElements<float>(float* out, const float* in, int count) {
+        memcpy(out, in, sizeof(float) * count);
+    }
+
+    template <>
+    inline void loadElements<Half>(float* out, const Half* in, int count) {
+        SIMD::halfToFloat(out, (const uint16_t*)in, count);
+    }
+
+    // out[i] = in[i] converted to T, the loop is simple enough to be vectorized
+    template <typename T>
+    inline void storeElements(T* out, const float* in, int count) {
+        for(int i = 0; i < count; i++)
+            out[i] = Element<T>::fromFloat(in[i]);
+    }
+
+    template <>
+    inline void storeElements<float>(float* out, const float* in, int count) {
+        memcpy(out, in, sizeof(float) * count);
+    }
+
+    template <>
+    inline void storeElements<Half>(Half* out, const float* in, int count) {
+        SIMD::floatToHalf((uint16_t*)out, in, count);
+    }
+
+    // Convert count elements of type at in into out through float
+    template <typename T>
+    void convertElements(T* out, const void* in, ElementType::ElementType type, int count) {
+        std::vector<float> line(count);
+        switch (type) {
+            case ElementType::uint8:
+                loadElements(line.data(), (const uint8_t*)in, count);
+                break;
+            case ElementType::uint16:
+                loadElements(line.data(), (const uint16_t*)in, count);
+                break;
+            case ElementType::half:
+                loadElements(line.data(), (const Half*)in, count);
+                break;
+            case ElementType::bfloat16:
+                loadElements(line.data(), (const BFloat16*)in, count);
+                break;
+            default:
+                loadElements(line.data(), (const float*)in, count);
+                break;
+        }
+        storeElements(out, line.data(), count);
+    }
+
+}
+
+#endif
@@ -0,0 +1,130 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : fft.hpp
+//  Purpose     : Support Fast Fourier Transform
+//  License     : MIT License
+
+#ifndef _LIBQIMG_FFT_HPP_
+#define _LIBQIMG_FFT_HPP_
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include "libqimg_math.hpp"
+
+namespace libqimg::FFT {
+
+    typedef std::complex<float> Complex;
+
+    // Return the smallest power of two not less than n
+    inline int nextPowerOfTwo(int n) {
+        int result = 1;
+        while(result < n) result <<= 1;
+        return result;
+    }
+
+    // Radix-2 complex FFT of a fixed power-of-two length
+    class Plan {
+      private:
+        int length;
+        std::vector<int> reversed;
+        std::vector<Complex> twiddles;
+      public:
+
+        Plan():length(0) {}
+
+        Plan(int length):length(length), reversed(length), twiddles(length / 2 + 1) {
+            int bits = 0;
+            while((1 << bits) < length) bits++;
+            for(int i = 0; i < length; i++) {
+                int r = 0;
+                for(int b = 0; b < bits; b++)
+                    if(i & (1 << b)) r |= 1 << (bits - 1 - b);
+                reversed[i] = r;
+            }
+            // Twiddles are computed in double, so long transforms keep float precision
+            for(int i = 0; i < length / 2; i++) {
+                double angle = -2.0 * M_PI * (double)i / (double)length;
+                twiddles[i] = Complex((float)cos(angle), (float)sin(angle));
+            }
+        }
+
+        inline int size() const { return length; }
+
+        // Transform in place. The inverse transform is not divided by the length.
+        void transform(Complex* data, bool inverse = false) const {
+            for(int i = 0; i < length; i++)
+                if(i < reversed[i]) std::swap(data[i], data[reversed[i]]);
+            for(int half = 1; half < length; half <<= 1) {
+                int step = length / (half * 2);
+                for(int begin = 0; begin < length; begin += half * 2)
+                    for(int k = 0; k < half; k++) {
+                        Complex w = twiddles[k * step];
+                        if(inverse) w = std::conj(w);
+                        Complex odd = data[begin + k + half] * w;
+                        data[begin + k + half] = data[begin + k] - odd;
+                        data[begin + k] += odd;
+                    }
+            }
+        }
+    };
+
+    /*
+        Real 2D Transform
+        A size x size real block is transformed into size / 2 + 1 columns of size bins,
+        the other half of the spectrum is the conjugate mirror.
+        The spectrum is stored column after column: spectrum[column * size + row].
+    */
+
+    // Forward transform of a real block, rows are stride floats apart.
+    // line must hold size complex numbers.
+    void forwardReal2D(const Plan& plan, const float* input, int stride, Complex* spectrum, Complex* line) {
+        int size = plan.size(), half = size / 2;
+        // Two real rows are transformed by one complex transform
+        for(int row = 0; row < size; row += 2) {
+            const float* a = input + (size_t)stride * row;
+            const float* b = a + stride;
+            for(int i = 0; i < size; i++)
+                line[i] = Complex(a[i], b[i]);
+            plan.transform(line);
+            for(int k = 0; k <= half; k++) {
+                Complex z = line[k], zm = std::conj(line[(size - k) % size]);
+                spectrum[(size_t)k * size + row] = (z + zm) * 0.5f;
+                spectrum[(size_t)k * size + row + 1] = (z - zm) * Complex(0.0f, -0.5f);
+            }
+        }
+        for(int k = 0; k <= half; k++)
+            plan.transform(spectrum + (size_t)k * size);
+    }
+
+    // Inverse transform into a real block, rows are stride floats apart. The result is multiplied by size * size.
+    // spectrum is overwritten, line must hold size complex numbers.
+    void inverseReal2D(const Plan& plan, Complex* spectrum, float* output, int stride, Complex* line) {
+        int size = plan.size(), half = size / 2;
+        for(int k = 0; k <= half; k++)
+            plan.transform(spectrum + (size_t)k * size, true);
+        for(int row = 0; row < size; row += 2) {
+            for(int k = 0; k < size; k++) {
+                Complex a, b;
+                if(k <= half) {
+                    a = spectrum[(size_t)k * size + row];
+                    b = spectrum[(size_t)k * size + row + 1];
+                } else {
+                    a = std::conj(spectrum[(size_t)(size - k) * size + row]);
+                    b = std::conj(spectrum[(size_t)(size - k) * size + row + 1]);
+                }
+                line[k] = a + b * Complex(0.0f, 1.0f);
+            }
+            plan.transform(line, true);
+            float* outA = output + (size_t)stride * row;
+            float* outB = outA + stride;
+            for(int i = 0; i < size; i++) {
+                outA[i] = line[i].real();
+                outB[i] = line[i].imag();
+            }
+        }
+    }
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : fileMapping.hpp
+//  Purpose     : Support Memory Mapped Files
+//  License     : MIT License
+
+#ifndef _LIBQIMG_FILEMAPPING_HPP_
+#define _LIBQIMG_FILEMAPPING_HPP_
+
+#include <string>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define _LIBQIMG_MMAP_SUPPORTED_
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "libqimg_debuglog.hpp"
+
+namespace libqimg::OpenMode {
+
+    // File open mode selection
+    enum OpenMode {
+        // Copy the file into memory
+        load = 0,
+        // Map the file, writing to the matrix is not allowed
+        mapReadOnly = 1,
+        // Map the file, writes stay private and never reach the file
+        mapCopyOnWrite = 2
+    };
+
+}
+
+namespace libqimg {
+
+    // A whole file mapped into memory
+    struct FileMapping {
+        char* data = nullptr;
+        size_t length = 0;
+
+        FileMapping() {}
+
+        // Map file, return false if the file cannot be mapped
+        bool open(const std::string& filename, OpenMode::OpenMode mode) {
+#ifdef _LIBQIMG_MMAP_SUPPORTED_
+            if(mode == OpenMode::load) return false;
+            int fd = ::open(filename.data(), O_RDONLY);
+            if(fd < 0) return false;
+            struct stat info;
+            if(fstat(fd, &info) != 0 || info.st_size <= 0) {
+                ::close(fd);
+                return false;
+            }
+            void* address = mmap(nullptr, info.st_size,
+                mode == OpenMode::mapReadOnly ? PROT_READ : PROT_READ | PROT_WRITE,
+                mode == OpenMode::mapReadOnly ? MAP_SHARED : MAP_PRIVATE,
+                fd, 0);
+            ::close(fd);
+            if(address == MAP_FAILED) return false;
+            data = (char*)address;
+            length = info.st_size;
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        inline bool mapped() const { return data != nullptr; }
+
+        // Unmap file
+        void close() {
+#ifdef _LIBQIMG_MMAP_SUPPORTED_
+            if(data != nullptr)
+                munmap(data, length);
+#endif
+            data = nullptr;
+            length = 0;
+        }
+    };
+
+}
+
+#endif
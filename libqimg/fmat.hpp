@@ -11,12 +11,16 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <new>
+#include <vector>
 
 #include "libqimg_debuglog.hpp"
 #include "libqimg_math.hpp"
 #include "point.hpp"
 #include "tilemode.hpp"
 #include "samplemode.hpp"
+#include "fileMapping.hpp"
+#include "element.hpp"
 
 namespace libqimg {
 
@@ -27,35 +31,216 @@ namespace libqimg {
         0x0008  int32   Height
         ......  float   Data
 
+        Typed Matrix File Structure (.fmat), written by matrices of any other element type
+        0x0000  int32   Signature 80 72 7F B4
+        0x0004  int32   Width
+        0x0008  int32   Height
+        0x000C  int32   Element Type, see ElementType
+        ......  element Data
+
         In the end of this file, you can write anything you want.
         Program won't read the tail of the file.
 
     */
 
-    float _LIBQIMG_FMAT_SAFEADDRESS = 0.0f;
+    /*
+        Memory Layout
+        Rows are placed rowStride elements apart. Rows of allocated matrices are aligned to
+        FMAT_ALIGNMENT bytes. Rows of mapped matrices start wherever the file puts them
+        and rows of views at their first column, aligned() tells which one applies.
+        Effects only use unaligned loads.
+        An optional apron of extra pixels surrounds the canvas, so kernels may read
+        up to apron pixels outside the canvas without tile mode checks.
+        The apron is filled by fillApron().
+    */
+
     const int FMAT_SIGNATURE = 0x80797FA4;
-    // Float Point Matrix
-    class FloatPointMatrix {
+    const int FMAT_TYPED_SIGNATURE = 0x80797FB4;
+    // Alignment of every matrix row in bytes
+    const int FMAT_ALIGNMENT = 64;
+    // Float count of a row alignment unit
+    const int FMAT_ALIGNMENT_FLOATS = FMAT_ALIGNMENT / sizeof(float);
+    // Strides of a multiple of this byte count map a whole column onto the same cache sets
+    const int FMAT_CACHE_ALIASING = 4096;
+
+    // Allocate elements aligned to FMAT_ALIGNMENT
+    template <typename T = float>
+    inline T* allocateAligned(size_t count) {
+        return (T*)::operator new[](count * sizeof(T), std::align_val_t(FMAT_ALIGNMENT));
+    }
+
+    // Free elements allocated by allocateAligned
+    template <typename T>
+    inline void freeAligned(T* ptr) {
+        ::operator delete[]((void*)ptr, std::align_val_t(FMAT_ALIGNMENT));
+    }
+
+    // Read the header of a matrix file, return false if the signature is unknown.
+    // type and the data offset are set from the signature.
+    inline bool readMatrixHeader(const char* header, size_t length, Point& size, ElementType::ElementType& type, size_t& offset) {
+        int signature, typeValue;
+        if(length < 12)
+            return false;
+        memcpy(&signature, header, 4);
+        memcpy(&size, header + 4, 8);
+        if(signature == FMAT_SIGNATURE) {
+            type = ElementType::float32;
+            offset = 12;
+            return true;
+        }
+        if(signature != FMAT_TYPED_SIGNATURE || length < 16)
+            return false;
+        memcpy(&typeValue, header + 12, 4);
+        if(!validElementType(typeValue))
+            return false;
+        type = (ElementType::ElementType)typeValue;
+        offset = 16;
+        return true;
+    }
+
+    // Matrix of element type T, effects read and write it as float
+    template <typename T>
+    class Matrix {
       private:
         bool openSucceed = false;
         Point size;
-        float* dataptr = nullptr;
+        int rowStride = 0;
+        int apron = 0;
+        T* storage = nullptr;
+        T* dataptr = nullptr;
+        FileMapping mapping;
+        // Returned for pixels outside of an empty edge
+        inline static T emptyElement = T();
+
+        inline static int alignUp(int count) {
+            return (count + ALIGNMENT_ELEMENTS - 1) / ALIGNMENT_ELEMENTS * ALIGNMENT_ELEMENTS;
+        }
+
+        // Allocate storage for the current size, apron and requested stride
+        void allocate(int requestedStride) {
+            int lead = alignUp(apron);
+            int minStride = alignUp(lead + size.x + apron);
+            if(requestedStride <= 0)
+                rowStride = paddedStride(minStride);
+            else
+                rowStride = math::max(alignUp(requestedStride), minStride);
+            storage = allocateAligned<T>((size_t)rowStride * (size.y + apron * 2));
+            dataptr = storage + (size_t)rowStride * apron + lead;
+        }
+        // Forget the data without freeing it
+        void release() {
+            storage = nullptr;
+            dataptr = nullptr;
+            mapping = FileMapping();
+            size = Point(0, 0);
+            rowStride = 0;
+            apron = 0;
+            openSucceed = false;
+        }
       public:
+
+        // Element count of a row alignment unit
+        static constexpr int ALIGNMENT_ELEMENTS = FMAT_ALIGNMENT / sizeof(T);
+        // Element type recorded in files
+        static constexpr ElementType::ElementType ELEMENT_TYPE = Element<T>::type;
+
+        // Return the automatic row stride in elements of rows holding count elements
+        inline static int paddedStride(int count) {
+            int stride = alignUp(count);
+            if((stride * (int)sizeof(T)) % FMAT_CACHE_ALIASING == 0)
+                stride += ALIGNMENT_ELEMENTS;
+            return stride;
+        }
+
+        // Empty matrix, holds no data
+        Matrix():size(Point(0, 0)) {}
       
         // Initialize a collection by size.
-        FloatPointMatrix(Point size):size(size) {
-            dataptr = new float[size.x * size.y];
+        // apron is the extra border in pixels, stride is the minimum row stride in elements (0 means automatic).
+        Matrix(Point size, int apron = 0, int stride = 0):size(size), apron(apron) {
+            allocate(stride);
             openSucceed = true;
         }
 
         // Initialize a collection by size.
-        FloatPointMatrix(int sizeX, int sizeY):size(Point(sizeX, sizeY)) {
-            dataptr = new float[sizeX * sizeY];
+        // apron is the extra border in pixels, stride is the minimum row stride in elements (0 means automatic).
+        Matrix(int sizeX, int sizeY, int apron = 0, int stride = 0):size(Point(sizeX, sizeY)), apron(apron) {
+            allocate(stride);
             openSucceed = true;
         }
 
-        // Read matrix from file
-        FloatPointMatrix(std::string filename) {
+        // Wrap external memory with rows stride elements apart, the matrix won't free it.
+        Matrix(T* data, Point size, int stride):size(size), rowStride(stride), dataptr(data) {
+            openSucceed = true;
+        }
+
+        // Matrices own their data, copies are made by copy() or copyFrom()
+        Matrix(const Matrix&) = delete;
+        Matrix& operator=(const Matrix&) = delete;
+
+        // Take the data of other, other is left empty
+        Matrix(Matrix&& other) noexcept:
+            openSucceed(other.openSucceed), size(other.size), rowStride(other.rowStride), apron(other.apron),
+            storage(other.storage), dataptr(other.dataptr), mapping(other.mapping) {
+            other.release();
+        }
+
+        // Free the data of this matrix and take the data of other, other is left empty
+        Matrix& operator=(Matrix&& other) noexcept {
+            if(this != &other) {
+                dispose();
+                openSucceed = other.openSucceed;
+                size = other.size;
+                rowStride = other.rowStride;
+                apron = other.apron;
+                storage = other.storage;
+                dataptr = other.dataptr;
+                mapping = other.mapping;
+                other.release();
+            }
+            return *this;
+        }
+
+        ~Matrix() { dispose(); }
+
+        // Read matrix from file, elements of another type are converted
+        // With a map mode the data is used in place, the matrix is loaded as usual if the file cannot be mapped
+        // or holds another element type.
+        Matrix(std::string filename, OpenMode::OpenMode openMode = OpenMode::load) {
+
+            ElementType::ElementType fileType;
+            size_t offset;
+            if(openMode != OpenMode::load && mapping.open(filename, openMode)) {
+                if(!readMatrixHeader(mapping.data, mapping.length, size, fileType, offset)) {
+#ifdef LIBQIMG_SHOWLOG
+                    printf("[FMAT \"%s\" ] : \"%s\" signature incorrect.\n", filename.data(), filename.data());
+#endif
+                    mapping.close();
+                    size = Point(0, 0);
+                    return;
+                }
+                if(fileType == ELEMENT_TYPE) {
+                    if(mapping.length < offset + sizeof(T) * (size_t)size.x * (size_t)size.y) {
+#ifdef LIBQIMG_SHOWLOG
+                        printf("[FMAT \"%s\" ] : \"%s\" is truncated.\n", filename.data(), filename.data());
+#endif
+                        mapping.close();
+                        size = Point(0, 0);
+                        return;
+                    }
+                    dataptr = (T*)(mapping.data + offset);
+                    rowStride = size.x;
+#ifdef LIBQIMG_SHOWLOG
+                    printf("[FMAT \"%s\" ] : File \"%s\" mapped successfully.\n", 
+                        filename.data(), 
+                        filename.data());
+#endif
+                    openSucceed = true;
+                    return;
+                }
+                // Elements of another type have to be converted
+                mapping.close();
+            }
 
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] : Opening file \"%s\"...\n", 
@@ -72,20 +257,24 @@ namespace libqimg {
                 return;
             }
             // Check file signature
+            char header[16];
+            file.read(header, 12);
             int fileSignature;
-            file.read((char*)&fileSignature, 4);
-            if(fileSignature != FMAT_SIGNATURE) {
+            memcpy(&fileSignature, header, 4);
+            if(fileSignature == FMAT_TYPED_SIGNATURE)
+                file.read(header + 12, 4);
+            if(!file || !readMatrixHeader(header, fileSignature == FMAT_TYPED_SIGNATURE ? 16 : 12, size, fileType, offset)) {
 #ifdef LIBQIMG_SHOWLOG
                 printf("[FMAT \"%s\" ] : \"%s\" signature incorrect.\n", filename.data(), filename.data());
 #endif
+                size = Point(0, 0);
                 return;
             }
             // Readin data
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] : Reading metadata...\n", filename.data());
 #endif
-            file.read((char*)&size, 8);
-            dataptr = new float[size.x * size.y];
+            allocate(0);
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] :  -> Resolution: %dx%d\n",
                 filename.data(),
@@ -95,9 +284,13 @@ namespace libqimg {
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] : Reading matrix data...\n", filename.data());
 #endif
-            for(int y = 0; y < size.y; y++)
-                for(int x = 0; x < size.x; x++)
-                    file.read((char*)&dataptr[y * size.x + x], 4);
+            if(!readData(file, fileType)) {
+#ifdef LIBQIMG_SHOWLOG
+                printf("[FMAT \"%s\" ] : \"%s\" is truncated.\n", filename.data(), filename.data());
+#endif
+                dispose();
+                return;
+            }
             file.close();
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] : File \"%s\" loaded successfully.\n", 
@@ -107,7 +300,7 @@ namespace libqimg {
             openSucceed = true;
         }
 
-        // Save file
+        // Save file, float matrices keep the float format and other element types write the typed one
         bool save(std::string filename) {
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] : Opening file \"%s\"...\n", 
@@ -127,14 +320,19 @@ namespace libqimg {
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] : Writing metadata...\n", filename.data());
 #endif
-            file.write((char*)&FMAT_SIGNATURE, 4);
-            file.write((char*)&size, 8);
+            if(ELEMENT_TYPE == ElementType::float32) {
+                file.write((char*)&FMAT_SIGNATURE, 4);
+                file.write((char*)&size, 8);
+            } else {
+                int typeValue = ELEMENT_TYPE;
+                file.write((char*)&FMAT_TYPED_SIGNATURE, 4);
+                file.write((char*)&size, 8);
+                file.write((char*)&typeValue, 4);
+            }
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] : Writing matrix data...\n", filename.data());
 #endif
-            for(int y = 0; y < size.y; y++)
-                for(int x = 0; x < size.x; x++)
-                    file.write((char*)&dataptr[y * size.x + x], 4);
+            writeData(file);
             file.close();
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMAT \"%s\" ] : File \"%s\" wrote successfully.\n", 
@@ -144,26 +342,75 @@ namespace libqimg {
             return true;
         }
 
-        // Free memory
+        // Read packed matrix data with a single read
+        // Data of another element type is read a row at a time and converted
+        bool readData(std::istream& file, ElementType::ElementType type = ELEMENT_TYPE) {
+            if(type != ELEMENT_TYPE) {
+                std::vector<char> line(elementSize(type) * size.x);
+                for(int y = 0; y < size.y && file; y++) {
+                    file.read(line.data(), line.size());
+                    convertElements(rowPtr(y), line.data(), type, size.x);
+                }
+                return (bool)file;
+            }
+            file.read((char*)dataptr, sizeof(T) * (size_t)size.x * (size_t)size.y);
+            // Move packed rows to their strided place, start from the last row so nothing is overwritten
+            if(rowStride != size.x)
+                for(int y = size.y - 1; y > 0; y--)
+                    memmove(rowPtr(y), dataptr + (size_t)size.x * y, sizeof(T) * size.x);
+            return (bool)file;
+        }
+
+        // Write packed matrix data, a single write if rows are contiguous
+        bool writeData(std::ostream& file) const {
+            if(rowStride == size.x)
+                file.write((const char*)dataptr, sizeof(T) * (size_t)size.x * (size_t)size.y);
+            else
+                for(int y = 0; y < size.y; y++)
+                    file.write((const char*)rowPtr(y), sizeof(T) * size.x);
+            return (bool)file;
+        }
+
+        // Free memory, the matrix is left empty
         void dispose() {
-            if(dataptr != nullptr)
-                delete[] dataptr;
+            if(storage != nullptr)
+                freeAligned(storage);
+            mapping.close();
+            release();
         }
 
-        // Adjust the canvas size.
+        // Adjust the canvas size, keep the overlapping content.
         void resizeCanvas(int sizeX, int sizeY) {
-            float* newDataptr = new float[sizeX * sizeY];
-            for(int y = 0; y < size.y; y++)
-                for(int x = 0; x < size.x; x++)
-                    newDataptr[y * sizeX + x] = dataptr[y * size.x + x];
-                    
-            delete[] dataptr;
-            dataptr = newDataptr;
+            T* oldStorage = storage;
+            FileMapping oldMapping = mapping;
+            T* oldDataptr = dataptr;
+            int oldStride = rowStride;
+            Point oldSize = size;
+            mapping = FileMapping();
+            size = Point(sizeX, sizeY);
+            allocate(0);
+            for(int y = 0; y < math::min(oldSize.y, size.y); y++)
+                memcpy(rowPtr(y), oldDataptr + (size_t)oldStride * y, sizeof(T) * math::min(oldSize.x, size.x));
+            if(oldStorage != nullptr)
+                freeAligned(oldStorage);
+            oldMapping.close();
+        }
+
+        // Return true if the data is mapped from a file
+        inline bool mapped() const { return mapping.mapped(); }
+
+        // Return true if every row starts at a multiple of FMAT_ALIGNMENT bytes
+        inline bool aligned() const {
+            return (uintptr_t)dataptr % FMAT_ALIGNMENT == 0 && rowStride % ALIGNMENT_ELEMENTS == 0;
         }
 
         inline Point canvasSize() const { return size; }
         inline int width() const { return size.x; }
         inline int height() const { return size.y; }
+        // Return the distance between two rows in elements
+        inline int stride() const { return rowStride; }
+        // Return the border width that can be read outside the canvas
+        inline int apronSize() const { return apron; }
 
         inline float aspectRatio() const { return (float)size.x / (float)size.y; }
 
@@ -199,41 +446,63 @@ namespace libqimg {
         // The left down corner point
         Point end() const { return Point(size.x - 1, size.y - 1); }
 
-        inline float& operator()(int x, int y, TileMode::TileMode tileMode = TileMode::clamp) {
+        // Return the rectangle from begin of regionSize, clipped to the canvas
+        inline void clip(Point& begin, Point& regionSize) const {
+            begin = Point(math::clamp(begin.x, 0, size.x), math::clamp(begin.y, 0, size.y));
+            regionSize = Point(
+                math::clamp(regionSize.x, 0, size.x - begin.x),
+                math::clamp(regionSize.y, 0, size.y - begin.y));
+        }
+
+        // Return a view of the rectangle from begin of regionSize, clipped to the canvas.
+        // The view shares the data and the stride of this matrix, nothing is copied and it has to outlive the view.
+        // Effects treat a view as a whole image, edge modes apply at the border of the view.
+        // Rows of the view are aligned only if begin.x is a multiple of ALIGNMENT_ELEMENTS.
+        Matrix view(Point begin, Point regionSize) {
+            clip(begin, regionSize);
+            return Matrix(dataptr + (ptrdiff_t)rowStride * begin.y + begin.x, regionSize, rowStride);
+        }
+
+        // Return the address of the first element of row y, elements of a row are contiguous
+        // Row -apron to size.y + apron - 1 are valid, and each row spans from -apron to size.x + apron - 1
+        inline T* rowPtr(int y) { return dataptr + (ptrdiff_t)rowStride * y; }
+        inline const T* rowPtr(int y) const { return dataptr + (ptrdiff_t)rowStride * y; }
+
+        inline T& operator()(int x, int y, TileMode::TileMode tileMode = TileMode::clamp) {
 
             if(x >= 0 && y >= 0 && x < size.x && y < size.y)
-                return dataptr[size.x * y + x];
+                return dataptr[rowStride * y + x];
             
             switch (tileMode) {
 
                 case TileMode::empty:
-                    return _LIBQIMG_FMAT_SAFEADDRESS;
+                    return emptyElement;
                     
                 case TileMode::clamp: {
                     x = math::clamp(x, 0, size.x - 1);
                     y = math::clamp(y, 0, size.y - 1);
-                    return dataptr[size.x * y + x];
+                    return dataptr[rowStride * y + x];
                 }
 
-                case TileMode::mirror: {
-                    x = math::mod(x, size.x);
-                    y = math::mod(y, size.y);
-                    return dataptr[size.x * y + x];
-                }
+                case TileMode::repeat:
+                    return dataptr[rowStride * TileMode::resolve<TileMode::repeat>(y, size.y) + TileMode::resolve<TileMode::repeat>(x, size.x)];
+
+                case TileMode::mirror:
+                    return dataptr[rowStride * TileMode::resolve<TileMode::mirror>(y, size.y) + TileMode::resolve<TileMode::mirror>(x, size.x)];
                 
                 default: {
-                    return _LIBQIMG_FMAT_SAFEADDRESS;
+                    return emptyElement;
                 }
             }
         }
-        inline float& operator()(Point pt, TileMode::TileMode tileMode = TileMode::clamp) {
+        inline T& operator()(Point pt, TileMode::TileMode tileMode = TileMode::clamp) {
              return (*this)(pt.x, pt.y, tileMode);
         }
-        inline float& operator()(PointF pt, TileMode::TileMode tileMode = TileMode::clamp) {
+        inline T& operator()(PointF pt, TileMode::TileMode tileMode = TileMode::clamp) {
             return (*this)(static_cast<Point>(pt), tileMode); 
         }
 
-        // Get value in readonly mode
+        // Get value as float in readonly mode
         float pixelAccess(
             int x, int y, 
             TileMode::TileMode tileMode = TileMode::clamp, 
@@ -241,47 +510,81 @@ namespace libqimg {
         ) const {
 
             if(x >= 0 && y >= 0 && x < size.x && y < size.y)
-                return dataptr[size.x * y + x];
+                return Element<T>::toFloat(dataptr[rowStride * y + x]);
             
             switch (tileMode) {
 
                 case TileMode::empty:
-                    return _LIBQIMG_FMAT_SAFEADDRESS;
+                    return 0.0f;
                     
                 case TileMode::clamp: {
                     x = math::clamp(x, 0, size.x - 1);
                     y = math::clamp(y, 0, size.y - 1);
-                    return dataptr[size.x * y + x];
+                    return Element<T>::toFloat(dataptr[rowStride * y + x]);
                 }
 
-                case TileMode::mirror: {
-                    x = math::mod(x, size.x);
-                    y = math::mod(y, size.y);
-                    return dataptr[size.x * y + x];
-                }
+                case TileMode::repeat:
+                    return Element<T>::toFloat(dataptr[rowStride * TileMode::resolve<TileMode::repeat>(y, size.y) + TileMode::resolve<TileMode::repeat>(x, size.x)]);
+
+                case TileMode::mirror:
+                    return Element<T>::toFloat(dataptr[rowStride * TileMode::resolve<TileMode::mirror>(y, size.y) + TileMode::resolve<TileMode::mirror>(x, size.x)]);
                 
                 default: {
-                    return _LIBQIMG_FMAT_SAFEADDRESS;
+                    return 0.0f;
                 }
             }
         }
 
+        // Get value as float in readonly mode, the tile mode is resolved at compile time
+        template <TileMode::TileMode tileMode>
+        inline float pixelAccess(int x, int y) const {
+            if(x >= 0 && y >= 0 && x < size.x && y < size.y)
+                return Element<T>::toFloat(dataptr[rowStride * y + x]);
+            if constexpr (tileMode == TileMode::empty)
+                return 0.0f;
+            else
+                return Element<T>::toFloat(dataptr[rowStride * TileMode::resolve<tileMode>(y, size.y) + TileMode::resolve<tileMode>(x, size.x)]);
+        }
+
+        // Sample at pt, the sample mode and the tile mode are resolved at compile time
+        template <SampleMode::SampleMode sampleMode, TileMode::TileMode tileMode>
+        inline float sample(PointF pt) const {
+            // Nearest takes the pixel covering pt
+            if constexpr (sampleMode == SampleMode::nearest)
+                return pixelAccess<tileMode>((int)floorf(pt.x), (int)floorf(pt.y));
+            else {
+                float fx = floorf(pt.x - 0.5f), fy = floorf(pt.y - 0.5f);
+                int x = (int)fx, y = (int)fy;
+                PointF t = PointF(pt.x - 0.5f - fx, pt.y - 0.5f - fy);
+                // All four pixels inside the canvas are read without any check
+                if(x >= 0 && y >= 0 && x + 1 < size.x && y + 1 < size.y) {
+                    const T* up = dataptr + rowStride * y + x;
+                    const T* down = up + rowStride;
+                    return SampleMode::bilinearSample(
+                        Element<T>::toFloat(up[0]), Element<T>::toFloat(up[1]),
+                        Element<T>::toFloat(down[0]), Element<T>::toFloat(down[1]), t);
+                }
+                return SampleMode::bilinearSample(
+                    pixelAccess<tileMode>(x, y), pixelAccess<tileMode>(x + 1, y),
+                    pixelAccess<tileMode>(x, y + 1), pixelAccess<tileMode>(x + 1, y + 1), t);
+            }
+        }
+
         inline float sample(
             PointF pt, 
             SampleMode::SampleMode sampleMode = SampleMode::nearest,
             TileMode::TileMode tileMode = TileMode::clamp
         ) {
             pt -= PointF(0.5f, 0.5f);
-            float lu = (*this)(floorf(pt.x), floorf(pt.y), tileMode);
-            float ru = (*this)(ceilf(pt.x), floorf(pt.y), tileMode);
-            float ld = (*this)(floorf(pt.x), ceilf(pt.y), tileMode);
-            float rd = (*this)(ceilf(pt.x), ceilf(pt.y), tileMode);
+            float lu = Element<T>::toFloat((*this)(floorf(pt.x), floorf(pt.y), tileMode));
+            float ru = Element<T>::toFloat((*this)(ceilf(pt.x), floorf(pt.y), tileMode));
+            float ld = Element<T>::toFloat((*this)(floorf(pt.x), ceilf(pt.y), tileMode));
+            float rd = Element<T>::toFloat((*this)(ceilf(pt.x), ceilf(pt.y), tileMode));
             PointF sp = pt - PointF(floorf(pt.x), floorf(pt.y));
             if(sampleMode == SampleMode::nearest)
                 return SampleMode::nearestSample(lu, ru, ld, rd, sp);
-            else if(sampleMode == SampleMode::bilinear)
-                return SampleMode::bilinearSample(lu, ru, ld, rd, sp);
-            return 0.0f;
+            // Wider filters are left to the resampler, they are point sampled as bilinear
+            return SampleMode::bilinearSample(lu, ru, ld, rd, sp);
         }
 
         #define FMAT_FOREACH_PARAMS float& reference
@@ -304,7 +607,7 @@ namespace libqimg {
 
         #define FMAT_PARAMETERIZED_FOREACH_PARAMS float& reference, Point current, FloatPointMatrix& matrix
         
-        // Execute specific function from begin to end, function parameters: (float& reference, Point current, FloatPointMatrix* matrix)
+        // Execute specific function from begin to end, function parameters: (float& reference, Point current, Matrix* matrix)
         template <class Function>
         void parameterizedForeach(Function function, Point begin, Point end ) {
             for(int y = begin.y; y <= end.y; y++)
@@ -312,7 +615,7 @@ namespace libqimg {
                     function((*this)(x, y), (Point){x, y}, *this);
         };
 
-        // Execute specific function from begin to end, function parameters: (float& reference, Point current, FloatPointMatrix* matrix)
+        // Execute specific function from begin to end, function parameters: (float& reference, Point current, Matrix* matrix)
         template <class Function>
         void parameterizedForeach(Function function) {
             for(int y = 0; y < size.y; y++)
@@ -321,35 +624,72 @@ namespace libqimg {
         };
 
         // Fill the matrix with a specific value
-        void erase(const float& value = 0.0f) {
-            foreach([value](float& reference) { reference = value; });
+        void erase(float value = 0.0f) {
+            T element = Element<T>::fromFloat(value);
+            foreach([element](T& reference) { reference = element; });
+        }
+
+        // Fill the apron with the values given by tile mode
+        void fillApron(TileMode::TileMode tileMode = TileMode::clamp) {
+            for(int y = -apron; y < size.y + apron; y++) {
+                T* row = rowPtr(y);
+                bool inner = y >= 0 && y < size.y;
+                for(int x = -apron; x < size.x + apron; x++) {
+                    if(inner && x == 0) x = size.x;
+                    if(x >= size.x + apron) break;
+                    row[x] = (*this)(x, y, tileMode);
+                }
+            }
         }
 
         // Copy matrix size
-        void copyCanvas(FloatPointMatrix& source) {
-            delete[] dataptr;
+        void copyCanvas(Matrix& source) {
+            dispose();
             size = source.canvasSize();
-            dataptr = new float[size.x, size.y];
+            apron = source.apronSize();
+            allocate(0);
+            openSucceed = true;
         }
 
         // Copy content
-        void copyContent(FloatPointMatrix& source) {
+        void copyContent(Matrix& source) {
+            if(source.canvasSize() == size) {
+                for(int y = 0; y < size.y; y++)
+                    memcpy(rowPtr(y), source.rowPtr(y), sizeof(T) * size.x);
+                return;
+            }
             for(int y = 0; y < size.y; y++)
                 for(int x = 0; x < size.x; x++)
                     (*this)(x, y) = source(x, y);
         }
 
+        // Copy content of a matrix of another element type, elements are converted through float
+        template <typename U>
+        void copyContent(Matrix<U>& source) {
+            if(source.canvasSize() == size) {
+                std::vector<float> line(size.x);
+                for(int y = 0; y < size.y; y++) {
+                    loadElements(line.data(), source.rowPtr(y), size.x);
+                    storeElements(rowPtr(y), line.data(), size.x);
+                }
+                return;
+            }
+            for(int y = 0; y < size.y; y++)
+                for(int x = 0; x < size.x; x++)
+                    (*this)(x, y) = Element<T>::fromFloat(source.pixelAccess(x, y));
+        }
+
         // Copy matrix from source
-        void copyFrom(FloatPointMatrix& source) {
+        void copyFrom(Matrix& source) {
             copyCanvas(source);
             copyContent(source);
         }
 
         // Create new object and copy from source
-        static FloatPointMatrix copy(FloatPointMatrix& source) {
-            FloatPointMatrix* ret = new FloatPointMatrix(source.canvasSize());
-            ret->copyContent(source);
-            return *ret;
+        static Matrix copy(Matrix& source) {
+            Matrix ret = Matrix(source.canvasSize());
+            ret.copyContent(source);
+            return ret;
         }
 
         // Return the average value of the appointed chunk
@@ -357,11 +697,12 @@ namespace libqimg {
             float sum = 0.0f;
             for(int y = begin.y; y <= end.y; y++)
                 for(int x = begin.x; x <= end.x; x++)
-                    sum += (*this)(x, y);
+                    sum += pixelAccess(x, y);
             return sum / (float)((end.x - begin.x + 1) * (end.y - begin.y + 1));
         }
 
-        // Return the average value of the appointed chunk
+        // Return the average value of the appointed chunk, the cost grows with its area.
+        // SummedAreaTable::average gives the same result, edges included, in constant time once the table is built.
         float average(PointF lu, PointF rd) {
 
             Point luOuter = Point(floorf(lu.x), floorf(lu.y));
@@ -371,30 +712,36 @@ namespace libqimg {
 
             for(int y = luOuter.y; y <= rdOuter.y; y++)
                 for(int x = luOuter.x; x <= rdOuter.x; x++)
-                    sum += (*this)(x, y);
+                    sum += pixelAccess(x, y);
 
             float lx = (lu.x - (float)luOuter.x), ly = (lu.y - (float)luOuter.y);
             float rx = ((float)rdOuter.x + 1.0f - rd.x), ry = ((float)rdOuter.y + 1.0f - rd.y);
             for(int y = luOuter.y; y <= rdOuter.y; y++) {
-                sum -= (*this)(luOuter.x, y) * lx;
-                sum -= (*this)(rdOuter.x, y) * rx;
+                sum -= pixelAccess(luOuter.x, y) * lx;
+                sum -= pixelAccess(rdOuter.x, y) * rx;
             }
             for(int x = luOuter.x; x <= rdOuter.x; x++) {
-                sum -= (*this)(x, luOuter.y) * ly;
-                sum -= (*this)(x, rdOuter.y) * ry;
+                sum -= pixelAccess(x, luOuter.y) * ly;
+                sum -= pixelAccess(x, rdOuter.y) * ry;
             }
 
-            sum += (*this)(luOuter.x, luOuter.y) * lx * ly;
-            sum += (*this)(luOuter.x, rdOuter.y) * lx * ry;
-            sum += (*this)(rdOuter.x, luOuter.y) * rx * ly;
-            sum += (*this)(rdOuter.x, rdOuter.y) * rx * ry;
+            sum += pixelAccess(luOuter.x, luOuter.y) * lx * ly;
+            sum += pixelAccess(luOuter.x, rdOuter.y) * lx * ry;
+            sum += pixelAccess(rdOuter.x, luOuter.y) * rx * ly;
+            sum += pixelAccess(rdOuter.x, rdOuter.y) * rx * ry;
 
             sum /= ((rd.x - lu.x) * (rd.y - lu.y));
             return sum;
         }
     };
     // Float Point Matrix
+    typedef Matrix<float> FloatPointMatrix;
     typedef FloatPointMatrix FMAT;
+    // Matrices of compact element types
+    typedef Matrix<uint8_t> UInt8Matrix;
+    typedef Matrix<uint16_t> UInt16Matrix;
+    typedef Matrix<Half> HalfMatrix;
+    typedef Matrix<BFloat16> BFloat16Matrix;
 
 }
 
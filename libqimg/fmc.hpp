@@ -11,6 +11,7 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <utility>
 
 #include "libqimg_debuglog.hpp"
 #include "point.hpp"
@@ -30,55 +31,227 @@ namespace libqimg {
             float   Data
         ]
 
+        Typed Matrix Collection File Structure (.fmc), written by collections of any other element type
+        0x0000  int32   Signature 80 72 7F B5
+        0x0004  int32   Width
+        0x0008  int32   Height
+        0x000C  uint16  ChannelCount
+        0x000E  uint16  Element Type, see ElementType
+        [
+            byte    Tag Length
+            string  Channel Tag
+            element Data
+        ]
+
         In the end of this file, you can write anything you want.
         Program won't read the tail of the file.
 
     */
 
+    /*
+        Memory Layout
+        Every channel is a plane of one aligned block, planes are planeSize elements apart
+        and share the same row stride. Channels are FMAT views onto their planes.
+        Mapped channels point into the file instead, only misaligned ones get a plane.
+    */
+
     const int FMC_SIGNATURE = 0x80797FA5;
-    // Float Point Matrix Collection
-    class FloatPointMatrixCollection {
+    const int FMC_TYPED_SIGNATURE = 0x80797FB5;
+
+    // Read the header of a collection file, return false if the signature is unknown.
+    // type and the offset of the first channel are set from the signature.
+    inline bool readCollectionHeader(
+        const char* header, size_t length,
+        Point& size, unsigned short& channelCount, ElementType::ElementType& type, size_t& offset
+    ) {
+        int signature;
+        unsigned short typeValue;
+        if(length < 14)
+            return false;
+        memcpy(&signature, header, 4);
+        memcpy(&size, header + 4, 8);
+        memcpy(&channelCount, header + 12, 2);
+        if(signature == FMC_SIGNATURE) {
+            type = ElementType::float32;
+            offset = 14;
+            return true;
+        }
+        if(signature != FMC_TYPED_SIGNATURE || length < 16)
+            return false;
+        memcpy(&typeValue, header + 14, 2);
+        if(!validElementType(typeValue))
+            return false;
+        type = (ElementType::ElementType)typeValue;
+        offset = 16;
+        return true;
+    }
+
+    // Collection of matrices of element type T sharing one canvas
+    template <typename T>
+    class MatrixCollection {
       private:
         bool openSucceed = false;
         Point size;
-        unsigned short channelCount;
-        std::string* channelTags;
-        FloatPointMatrix** channels;
+        unsigned short channelCount = 0;
+        std::string* channelTags = nullptr;
+        Matrix<T>* channels = nullptr;
+        T* planes = nullptr;
+        size_t planeSize = 0;
+        int rowStride = 0;
+        FileMapping mapping;
+        // Returned by operator[] for tags not in the collection, every collection has its own
+        Matrix<T> missingChannel;
+
+        // Allocate the plane block for the current size and channel count
+        void allocatePlanes() {
+            rowStride = Matrix<T>::paddedStride(size.x);
+            planeSize = (size_t)rowStride * size.y;
+            // Planes a multiple of 4 KiB apart would put a pixel of every channel into the same cache sets
+            if((planeSize * sizeof(T)) % FMAT_CACHE_ALIASING == 0)
+                planeSize += Matrix<T>::ALIGNMENT_ELEMENTS;
+            planes = allocateAligned<T>(planeSize * channelCount);
+        }
+
+        // Return the view of plane ch
+        inline Matrix<T> planeView(int ch) {
+            return Matrix<T>(planes + planeSize * ch, size, rowStride);
+        }
+
+        // Allocate channels as views onto a new plane block
+        void allocateChannels() {
+            channels = new Matrix<T>[channelCount];
+            channelTags = new std::string[channelCount];
+            allocatePlanes();
+            for(int ch = 0; ch < channelCount; ch++)
+                channels[ch] = planeView(ch);
+        }
+
+        // Use the mapped file as channel data, return false if the file is invalid.
+        // On failure the caller has to dispose the channels set up so far.
+        bool openMapped() {
+            size_t offset;
+            ElementType::ElementType fileType;
+            if(!readCollectionHeader(mapping.data, mapping.length, size, channelCount, fileType, offset) ||
+               fileType != ELEMENT_TYPE) {
+                size = Point(0, 0);
+                channelCount = 0;
+                return false;
+            }
+            size_t channelBytes = sizeof(T) * (size_t)size.x * (size_t)size.y;
+            channels = new Matrix<T>[channelCount];
+            channelTags = new std::string[channelCount];
+            for(int ch = 0; ch < channelCount; ch++) {
+                unsigned char tagLen = offset < mapping.length ? (unsigned char)mapping.data[offset] : 0;
+                if(offset + 1 + tagLen + channelBytes > mapping.length)
+                    return false;
+                channelTags[ch] = std::string(mapping.data + offset + 1, tagLen);
+                offset += 1 + tagLen;
+                if(offset % sizeof(T) == 0)
+                    channels[ch] = Matrix<T>((T*)(mapping.data + offset), size, size.x);
+                else {
+                    // Misaligned data cannot be used in place, it is copied to its plane
+                    if(planes == nullptr)
+                        allocatePlanes();
+                    channels[ch] = planeView(ch);
+                    for(int y = 0; y < size.y; y++)
+                        memcpy(channels[ch].rowPtr(y), mapping.data + offset + sizeof(T) * (size_t)size.x * y, sizeof(T) * size.x);
+                }
+                offset += channelBytes;
+            }
+            return true;
+        }
+        // Forget the data without freeing it
+        void release() {
+            openSucceed = false;
+            size = Point(0, 0);
+            channelCount = 0;
+            channelTags = nullptr;
+            channels = nullptr;
+            planes = nullptr;
+            planeSize = 0;
+            rowStride = 0;
+            mapping = FileMapping();
+        }
+
+        // Move the data of other into this empty collection
+        void take(MatrixCollection& other) {
+            openSucceed = other.openSucceed;
+            size = other.size;
+            channelCount = other.channelCount;
+            channelTags = other.channelTags;
+            channels = other.channels;
+            planes = other.planes;
+            planeSize = other.planeSize;
+            rowStride = other.rowStride;
+            mapping = other.mapping;
+            other.release();
+        }
       public:
 
+        // Element type recorded in files
+        static constexpr ElementType::ElementType ELEMENT_TYPE = Element<T>::type;
+
+        // Empty collection, holds no channel
+        MatrixCollection():size(Point(0, 0)) {}
+
         // Initialize a collection by size and channel count.
-        FloatPointMatrixCollection(
+        MatrixCollection(
             Point size, 
             unsigned short channelCount
         ):size(size), channelCount(channelCount) {
             
-            channels = new FloatPointMatrix*[channelCount];
-            channelTags = new std::string[channelCount];
-            for(int i = 0; i < channelCount; i++)
-                channels[i] = new FloatPointMatrix(size);
+            allocateChannels();
             openSucceed = true;
         }
 
         // Initialize a collection by size and channel count.
-        FloatPointMatrixCollection(
+        MatrixCollection(
             int sizeX, int sizeY, 
             unsigned short channelCount
         ):size(Point(sizeX, sizeY)), channelCount(channelCount) {
 
-            channels = new FloatPointMatrix*[channelCount];
-            channelTags = new std::string[channelCount];
-            for(int i = 0; i < channelCount; i++)
-                channels[i] = new FloatPointMatrix(size);
+            allocateChannels();
             openSucceed = true;
         }
 
-        // Read collection from file
-        FloatPointMatrixCollection(std::string filename) {
+        // Read collection from file, elements of another type are converted
+        // With a map mode the channel data is used in place, the collection is loaded as usual if the file cannot be mapped
+        // or holds another element type.
+        MatrixCollection(std::string filename, OpenMode::OpenMode openMode = OpenMode::load) {
             
             char tagTemp[256];
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMC \"%s\" ] Opening file \"%s\" ...\n", filename.data(), filename.data());
 #endif    
+            ElementType::ElementType fileType;
+            size_t offset;
+            // Elements of another type have to be converted, the file is loaded instead
+            if(openMode != OpenMode::load && mapping.open(filename, openMode) &&
+               readCollectionHeader(mapping.data, mapping.length, size, channelCount, fileType, offset) &&
+               fileType != ELEMENT_TYPE) {
+                mapping.close();
+                size = Point(0, 0);
+                channelCount = 0;
+            }
+            if(mapping.mapped()) {
+                if(!openMapped()) {
+#ifdef LIBQIMG_SHOWLOG
+                    printf("[FMC \"%s\" ] \"%s\"  is not a valid collection.\n", 
+                        filename.data(), 
+                        filename.data());
+#endif
+                    // Channels before the bad one point into the mapping, drop them with it
+                    dispose();
+                    return;
+                }
+#ifdef LIBQIMG_SHOWLOG
+                printf("[FMC \"%s\" ] File \"%s\"  mapped successfully.\n", 
+                    filename.data(), 
+                    filename.data());
+#endif
+                openSucceed = true;
+                return;
+            }
             auto file = std::ifstream(filename, std::ios::in | std::ios::binary);
             if(!file) {
 #ifdef LIBQIMG_SHOWLOG
@@ -87,9 +260,15 @@ namespace libqimg {
                 return;
             }
             // Check file signature
+            char header[16];
+            file.read(header, 14);
             int fileSignature;
-            file.read((char*)&fileSignature, 4);
-            if(fileSignature != FMC_SIGNATURE) {
+            memcpy(&fileSignature, header, 4);
+            if(fileSignature == FMC_TYPED_SIGNATURE)
+                file.read(header + 14, 2);
+            if(!file || !readCollectionHeader(header, fileSignature == FMC_TYPED_SIGNATURE ? 16 : 14, size, channelCount, fileType, offset)) {
+                size = Point(0, 0);
+                channelCount = 0;
 #ifdef LIBQIMG_SHOWLOG
                 printf("[FMC \"%s\" ] \"%s\"  signature incorrect.\n", 
                     filename.data(), 
@@ -100,11 +279,8 @@ namespace libqimg {
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMC \"%s\" ] Reading metadata...\n", filename.data());
 #endif
-            file.read((char*)&size, 8);
-            file.read((char*)&channelCount, 2);
             // Build channels and readin
-            channels = new FloatPointMatrix*[channelCount];
-            channelTags = new std::string[channelCount];
+            allocateChannels();
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMC \"%s\" ]  -> Resolution: %dx%d\n",
                 filename.data(),
@@ -115,8 +291,6 @@ namespace libqimg {
                 channelCount);
 #endif
             for(int ch = 0; ch < channelCount; ch++) {
-                // Allocate memory
-                channels[ch] = new FloatPointMatrix(size);
                 // Read channel tag
                 unsigned char tagLen;
                 file.read((char*)&tagLen, 1);
@@ -134,9 +308,13 @@ namespace libqimg {
                 printf("[FMC \"%s\" ]  -> Reading channel %d matrix data...\n", 
                     filename.data(), ch);
 #endif
-                for(int y = 0; y < size.y; y++)
-                    for(int x = 0; x < size.x; x++)
-                        file.read((char*)&(*channels[ch])(x, y), 4);
+                if(!file || !channels[ch].readData(file, fileType)) {
+#ifdef LIBQIMG_SHOWLOG
+                    printf("[FMC \"%s\" ] \"%s\"  is truncated.\n", filename.data(), filename.data());
+#endif
+                    dispose();
+                    return;
+                }
 #ifdef LIBQIMG_SHOWLOG
                 printf("[FMC \"%s\" ]  -> Channel %d matrix loaded.\n", 
                     filename.data(), ch);
@@ -151,7 +329,7 @@ namespace libqimg {
             openSucceed = true;
         }
 
-        // Save file
+        // Save file, float collections keep the float format and other element types write the typed one
         bool save(std::string filename) {
             
 #ifdef LIBQIMG_SHOWLOG 
@@ -172,9 +350,13 @@ namespace libqimg {
 #ifdef LIBQIMG_SHOWLOG
             printf("[FMC \"%s\" ] Writing metadata...\n", filename.data());
 #endif
-            file.write((char*)&FMC_SIGNATURE, 4);
+            file.write((char*)(ELEMENT_TYPE == ElementType::float32 ? &FMC_SIGNATURE : &FMC_TYPED_SIGNATURE), 4);
             file.write((char*)&size, 8);
             file.write((char*)&channelCount, 2);
+            if(ELEMENT_TYPE != ElementType::float32) {
+                unsigned short typeValue = ELEMENT_TYPE;
+                file.write((char*)&typeValue, 2);
+            }
             for(int ch = 0; ch < channelCount; ch++) {
                 // Write Channel Tag
                 unsigned char tagLen = channelTags[ch].length();
@@ -192,9 +374,7 @@ namespace libqimg {
                     filename.data(), 
                     ch);
 #endif
-                for(int y = 0; y < size.y; y++)
-                    for(int x = 0; x < size.x; x++)
-                        file.write((char*)&(*channels[ch])(x, y), 4);
+                channels[ch].writeData(file);
 #ifdef LIBQIMG_SHOWLOG
                 printf("[FMC \"%s\" ]  -> Channel %d matrix wrote.\n", 
                     filename.data(), 
@@ -211,18 +391,58 @@ namespace libqimg {
         }
 
 
-        // Free memory
+        // Collections own their data, copies are made by copy() or copyFrom()
+        MatrixCollection(const MatrixCollection&) = delete;
+        MatrixCollection& operator=(const MatrixCollection&) = delete;
+
+        // Take the data of other, other is left empty
+        MatrixCollection(MatrixCollection&& other) noexcept {
+            take(other);
+        }
+
+        // Free the data of this collection and take the data of other, other is left empty
+        MatrixCollection& operator=(MatrixCollection&& other) noexcept {
+            if(this != &other) {
+                dispose();
+                take(other);
+            }
+            return *this;
+        }
+
+        ~MatrixCollection() { dispose(); }
+
+        // Free memory, the collection is left empty
         void dispose() {
             for(int i = 0; i < channelCount; i++)
-                channels[i]->dispose();
+                channels[i].dispose();
             delete[] channels;
             delete[] channelTags;
+            if(planes != nullptr)
+                freeAligned(planes);
+            mapping.close();
+            release();
         }
 
-        // Adjust the canvas size.
+        // Adjust the canvas size, keep the overlapping content.
         void resizeCanvas(int sizeX, int sizeY) {
-            for(int i = 0; i < channelCount; i++)
-                channels[i]->resizeCanvas(sizeX, sizeY);
+            T* oldPlanes = planes;
+            FileMapping oldMapping = mapping;
+            Matrix<T>* oldChannels = channels;
+            Point oldSize = size;
+            mapping = FileMapping();
+            size = Point(sizeX, sizeY);
+            channels = new Matrix<T>[channelCount];
+            allocatePlanes();
+            for(int ch = 0; ch < channelCount; ch++) {
+                channels[ch] = planeView(ch);
+                for(int y = 0; y < math::min(oldSize.y, size.y); y++)
+                    memcpy(channels[ch].rowPtr(y), oldChannels[ch].rowPtr(y), sizeof(T) * math::min(oldSize.x, size.x));
+                oldChannels[ch].dispose();
+            }
+            delete[] oldChannels;
+            if(oldPlanes != nullptr)
+                freeAligned(oldPlanes);
+            oldMapping.close();
         }
 
         /* Function same as FMAT */
@@ -233,6 +453,19 @@ namespace libqimg {
         inline unsigned short count() const { return channelCount; }
         inline std::string& channelName(unsigned short channelID) { return channelTags[channelID]; }
 
+        // Return true if the channel data is mapped from a file
+        inline bool mapped() const { return mapping.mapped(); }
+
+        // Return true if every channel is a plane of the block returned by data()
+        inline bool planar() const { return planes != nullptr && !mapping.mapped(); }
+        // Return the first element of the plane block
+        inline T* data() { return planes; }
+        inline const T* data() const { return planes; }
+        // Return the distance between two planes in elements
+        inline size_t planeStride() const { return planeSize; }
+        // Return the distance between two rows of a plane in elements
+        inline int stride() const { return rowStride; }
+
         inline float aspectRatio() const { return (float)size.x / (float)size.y; }
 
         // Return the Point mapped from [-0.5 ~ size - 0.5] to [-1, 1]
@@ -267,13 +500,33 @@ namespace libqimg {
         // The left down corner point
         Point end() const { return Point(size.x - 1, size.y - 1); }
 
-        inline FloatPointMatrix& operator[](int index) { return (*channels[index]); }
+        inline Matrix<T>& operator[](int index) { return channels[index]; }
+
+        // Return a view of the rectangle from begin of regionSize in every channel, clipped to the canvas.
+        // Channels of the view share the data of this collection, it has to outlive the view.
+        MatrixCollection view(Point begin, Point regionSize) {
+            MatrixCollection ret;
+            ret.size = regionSize;
+            if(channelCount > 0)
+                channels[0].clip(begin, ret.size);
+            ret.channelCount = channelCount;
+            ret.channels = new Matrix<T>[channelCount];
+            ret.channelTags = new std::string[channelCount];
+            for(int ch = 0; ch < channelCount; ch++) {
+                ret.channels[ch] = channels[ch].view(begin, regionSize);
+                ret.channelTags[ch] = channelTags[ch];
+            }
+            ret.openSucceed = true;
+            return ret;
+        }
         
-        FloatPointMatrix& operator[](std::string index) {
+        Matrix<T>& operator[](std::string index) {
             for(int ch = 0; ch < channelCount; ch++)
                 if(index == channelTags[ch])
-                    return (*channels[ch]);
-            return *(new FloatPointMatrix(0, 0));
+                    return channels[ch];
+            // Misses return the empty matrix of this collection, it is emptied again in case it was written to
+            missingChannel = Matrix<T>();
+            return missingChannel;
         }
 
         // Return the channel ID
@@ -287,7 +540,7 @@ namespace libqimg {
 
         #define FMC_CANVAS_FOREACH_PARAMS const Point& current, FloatPointMatrixCollection& collection
 
-        // Execute specific function at all position from begin to end, function parameters: (Point current, FloatPointMatrixCollection& collection, FloatPointMatrix& matrix)
+        // Execute specific function at all position from begin to end, function parameters: (Point current, MatrixCollection& collection, Matrix<T>& matrix)
         template <class Function>
         void canvasForeach(Function function, Point begin, Point end) {
             for(int y = begin.y; y <= end.y; y++)
@@ -295,7 +548,7 @@ namespace libqimg {
                     function(Point(x, y), *this);
         };
 
-        // Execute specific function at all position from begin to end, function parameters: (Point current, FloatPointMatrixCollection& collection, FloatPointMatrix& matrix)
+        // Execute specific function at all position from begin to end, function parameters: (Point current, MatrixCollection& collection, Matrix<T>& matrix)
         template <class Function>
         void canvasForeach(Function function) {
             for(int y = 0; y < size.y; y++)
@@ -305,7 +558,7 @@ namespace libqimg {
 
         #define FMC_CHANNEL_FOREACH_PARAMS const Point& current, unsigned short channelID, FloatPointMatrixCollection& collection, FloatPointMatrix& matrix
 
-        // Execute specific function at all position from begin to end, function parameters: (Point current, unsigned short channelID, FloatPointMatrixCollection& collection, FloatPointMatrix& matrix)
+        // Execute specific function at all position from begin to end, function parameters: (Point current, unsigned short channelID, MatrixCollection& collection, Matrix<T>& matrix)
         template <class Function>
         void channelForeach(Function function, Point begin, Point end) {
             for(int ch = 0; ch < channelCount; ch++)
@@ -314,7 +567,15 @@ namespace libqimg {
                         function(Point(x, y), ch, *this, (*this)[ch]);
         };
 
-        // Execute specific function at all position from begin to end, function parameters: (Point current, unsigned short channelID, FloatPointMatrixCollection& collection, FloatPointMatrix& matrix)
+        // Execute specific function at all position of a single channel from begin to end, function parameters: (Point current, unsigned short channelID, MatrixCollection& collection, Matrix<T>& matrix)
+        template <class Function>
+        void channelForeach(Function function, unsigned short channelID, Point begin, Point end) {
+            for(int y = begin.y; y <= end.y; y++)
+                for(int x = begin.x; x <= end.x; x++)
+                    function(Point(x, y), channelID, *this, (*this)[channelID]);
+        };
+
+        // Execute specific function at all position from begin to end, function parameters: (Point current, unsigned short channelID, MatrixCollection& collection, Matrix<T>& matrix)
         template <class Function>
         void channelForeach(Function function) {
             for(int ch = 0; ch < channelCount; ch++)
@@ -324,42 +585,63 @@ namespace libqimg {
         };
 
         // Copy matrix size
-        void copyCanvas(FloatPointMatrixCollection& source) {
+        void copyCanvas(MatrixCollection& source) {
             dispose();
             size = source.canvasSize();
             channelCount = source.count();
-            channelTags = new std::string[channelCount];
-            channels = new FloatPointMatrix*[channelCount];
-            for(int ch = 0; ch < channelCount; ch++) {
-                channels[ch] = new FloatPointMatrix(size);
+            allocateChannels();
+            for(int ch = 0; ch < channelCount; ch++)
                 channelTags[ch] = source.channelName(ch);
-            }
+            openSucceed = true;
         }
         
         // Copy content
-        void copyContent(FloatPointMatrixCollection& source) {
+        void copyContent(MatrixCollection& source) {
+            // Same layout, the whole block is copied at once
+            if(planar() && source.planar() && source.canvasSize() == size && source.count() == channelCount &&
+               source.stride() == rowStride && source.planeStride() == planeSize) {
+                memcpy(planes, source.data(), sizeof(T) * planeSize * channelCount);
+                return;
+            }
             for(int ch = 0; ch < channelCount; ch++)
-                for(int y = 0; y < size.y; y++)
-                    for(int x = 0; x < size.x; x++)
-                        (*this)[ch](x, y) = source[ch](x, y);
+                channels[ch].copyContent(source[ch]);
+        }
+
+        // Exchange the planes with other, return false if the layouts differ.
+        // Channel tags stay, nothing is copied.
+        bool swapContent(MatrixCollection& other) {
+            if(!planar() || !other.planar() || other.canvasSize() != size || other.count() != channelCount ||
+               other.stride() != rowStride || other.planeStride() != planeSize)
+                return false;
+            std::swap(planes, other.planes);
+            std::swap(channels, other.channels);
+            return true;
         }
 
         // Copy collection from source
-        void copyFrom(FloatPointMatrixCollection& source) {
+        void copyFrom(MatrixCollection& source) {
             copyCanvas(source);
             copyContent(source);
         }
 
         // Create new object and copy from source
-        static FloatPointMatrixCollection copy(FloatPointMatrixCollection& source) {
-            FloatPointMatrixCollection* ret = new FloatPointMatrixCollection(source.canvasSize(), source.count());
-            ret->copyContent(source);
-            return *ret;
+        static MatrixCollection copy(MatrixCollection& source) {
+            MatrixCollection ret = MatrixCollection(source.canvasSize(), source.count());
+            for(int ch = 0; ch < ret.count(); ch++)
+                ret.channelTags[ch] = source.channelName(ch);
+            ret.copyContent(source);
+            return ret;
         }
 
     };
     // Float Point Matrix Collection
+    typedef MatrixCollection<float> FloatPointMatrixCollection;
     typedef FloatPointMatrixCollection FMC;
+    // Collections of compact element types
+    typedef MatrixCollection<uint8_t> UInt8MatrixCollection;
+    typedef MatrixCollection<uint16_t> UInt16MatrixCollection;
+    typedef MatrixCollection<Half> HalfMatrixCollection;
+    typedef MatrixCollection<BFloat16> BFloat16MatrixCollection;
 
 }
 
@@ -0,0 +1,232 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : fmci.hpp
+//  Purpose     : Type of interleaved RGBA FloatPointMatrix Collection
+//  License     : MIT License
+
+#ifndef _LIBQIMG_FMCI_HPP_
+#define _LIBQIMG_FMCI_HPP_
+
+#include <cstring>
+#include <cmath>
+#include <vector>
+
+#include "libqimg_debuglog.hpp"
+#include "libqimg_math.hpp"
+#include "point.hpp"
+#include "color.hpp"
+#include "simd.hpp"
+#include "fmat.hpp"
+#include "fmc.hpp"
+
+namespace libqimg {
+
+    /*
+        Interleaved Memory Layout
+        Every pixel is a TileMode::Color, 4 floats R G B A next to each other.
+        Rows are aligned to FMAT_ALIGNMENT bytes and placed rowStride pixels apart,
+        so one pixel fills one 128-bit register and all channels are sampled together.
+        Channel c of a planar collection maps to component c, missing components are R G B = 0, A = 1.
+    */
+
+    const int FMCI_COMPONENTS = 4;
+
+    // Float Point Matrix Collection, interleaved RGBA
+    class FloatPointMatrixCollectionInterleaved {
+
+      private:
+        Point size;
+        int rowStride = 0;
+        TileMode::Color* dataptr = nullptr;
+
+        void allocate() {
+            rowStride = FloatPointMatrix::paddedStride(size.x * FMCI_COMPONENTS) / FMCI_COMPONENTS;
+            dataptr = (TileMode::Color*)allocateAligned((size_t)rowStride * FMCI_COMPONENTS * size.y);
+        }
+
+      public:
+
+        FloatPointMatrixCollectionInterleaved():size(Point(0, 0)) {}
+
+        FloatPointMatrixCollectionInterleaved(Point size):size(size) {
+            allocate();
+        }
+
+        FloatPointMatrixCollectionInterleaved(int sizeX, int sizeY):size(Point(sizeX, sizeY)) {
+            allocate();
+        }
+
+        // Create from a planar collection, see fromPlanar
+        FloatPointMatrixCollectionInterleaved(FloatPointMatrixCollection& source):size(source.canvasSize()) {
+            allocate();
+            fromPlanar(source);
+        }
+
+        // Collections own their data, copies are made by copyContent()
+        FloatPointMatrixCollectionInterleaved(const FloatPointMatrixCollectionInterleaved&) = delete;
+        FloatPointMatrixCollectionInterleaved& operator=(const FloatPointMatrixCollectionInterleaved&) = delete;
+
+        // Take the data of other, other is left empty
+        FloatPointMatrixCollectionInterleaved(FloatPointMatrixCollectionInterleaved&& other) noexcept:
+            size(other.size), rowStride(other.rowStride), dataptr(other.dataptr) {
+            other.size = Point(0, 0);
+            other.rowStride = 0;
+            other.dataptr = nullptr;
+        }
+
+        // Free the data of this collection and take the data of other, other is left empty
+        FloatPointMatrixCollectionInterleaved& operator=(FloatPointMatrixCollectionInterleaved&& other) noexcept {
+            if(this != &other) {
+                dispose();
+                size = other.size;
+                rowStride = other.rowStride;
+                dataptr = other.dataptr;
+                other.size = Point(0, 0);
+                other.rowStride = 0;
+                other.dataptr = nullptr;
+            }
+            return *this;
+        }
+
+        ~FloatPointMatrixCollectionInterleaved() { dispose(); }
+
+        // Free memory, the collection is left empty
+        void dispose() {
+            if(dataptr)
+                freeAligned((float*)dataptr);
+            dataptr = nullptr;
+            size = Point(0, 0);
+            rowStride = 0;
+        }
+
+        inline Point canvasSize() const { return size; }
+        inline int width() const { return size.x; }
+        inline int height() const { return size.y; }
+        // Pixels between the beginnings of two rows
+        inline int stride() const { return rowStride; }
+
+        inline float aspectRatio() const { return (float)size.x / (float)size.y; }
+
+        // Return the Point mapped from [-0.5 ~ size - 0.5] to [-1, 1]
+        inline PointF coordinate(PointF position) const {
+            return PointF::reverseLerp(
+                PointF(((float)size.x) / 2.0f, ((float)size.y) / 2.0f),
+                PointF((float)size.x, (float)size.y),
+                position);
+        }
+
+        // Return the Point mapped from [-0.5 ~ size - 0.5] to [-1, 1]
+        inline PointF coordinate(Point position) const {
+            return coordinate(PointF((float)position.x + 0.5f, (float)position.y + 0.5f));
+        }
+
+        // Return the pixel position of coordinate
+        inline PointF positionFloat(PointF coordinate) const {
+            return PointF::lerp(
+                PointF(((float)(size.x)) / 2.0f, ((float)(size.y)) / 2.0f),
+                PointF((float)(size.x), (float)(size.y)),
+                coordinate);
+        }
+
+        // Return the address of the first pixel of row y
+        inline TileMode::Color* rowPtr(int y) { return dataptr + (ptrdiff_t)rowStride * y; }
+        inline const TileMode::Color* rowPtr(int y) const { return dataptr + (ptrdiff_t)rowStride * y; }
+
+        // Pixels out of the canvas are clamped
+        inline TileMode::Color& operator()(int x, int y) {
+            x = math::clamp(x, 0, size.x - 1);
+            y = math::clamp(y, 0, size.y - 1);
+            return dataptr[rowStride * y + x];
+        }
+        inline TileMode::Color& operator()(Point pt) { return (*this)(pt.x, pt.y); }
+
+        // Get pixel in readonly mode, the tile mode is resolved at compile time
+        // Empty pixels are zero in every component, like an empty FMAT in every channel
+        template <TileMode::TileMode tileMode>
+        inline TileMode::Color pixelAccess(int x, int y) const {
+            if(x >= 0 && y >= 0 && x < size.x && y < size.y)
+                return dataptr[rowStride * y + x];
+            if constexpr (tileMode == TileMode::empty)
+                return TileMode::Color(0.0f, 0.0f, 0.0f, 0.0f);
+            else
+                return dataptr[rowStride * TileMode::resolve<tileMode>(y, size.y) + TileMode::resolve<tileMode>(x, size.x)];
+        }
+
+        // Get pixel in readonly mode
+        TileMode::Color pixelAccess(int x, int y, TileMode::TileMode tileMode = TileMode::clamp) const {
+            return TileMode::dispatch(tileMode, [&](auto tile) {
+                return pixelAccess<decltype(tile)::value>(x, y);
+            });
+        }
+
+        // Sample all channels at pt, same positions and weights as FMAT::sample
+        template <SampleMode::SampleMode sampleMode, TileMode::TileMode tileMode>
+        inline TileMode::Color sample(PointF pt) const {
+            if constexpr (sampleMode == SampleMode::nearest)
+                return pixelAccess<tileMode>((int)floorf(pt.x), (int)floorf(pt.y));
+            else {
+                float fx = floorf(pt.x - 0.5f), fy = floorf(pt.y - 0.5f);
+                int x = (int)fx, y = (int)fy;
+                PointF t = PointF(pt.x - 0.5f - fx, pt.y - 0.5f - fy);
+                TileMode::Color lu, ru, ld, rd;
+                if(x >= 0 && y >= 0 && x + 1 < size.x && y + 1 < size.y) {
+                    const TileMode::Color* up = dataptr + rowStride * y + x;
+                    const TileMode::Color* down = up + rowStride;
+                    lu = up[0], ru = up[1], ld = down[0], rd = down[1];
+                } else {
+                    lu = pixelAccess<tileMode>(x, y), ru = pixelAccess<tileMode>(x + 1, y);
+                    ld = pixelAccess<tileMode>(x, y + 1), rd = pixelAccess<tileMode>(x + 1, y + 1);
+                }
+                TileMode::Color u = TileMode::Color::lerp(lu, ru, t.x);
+                TileMode::Color d = TileMode::Color::lerp(ld, rd, t.x);
+                return TileMode::Color::lerp(u, d, t.y);
+            }
+        }
+
+        // Fill every pixel with color
+        void erase(TileMode::Color color = TileMode::Color(0.0f, 0.0f, 0.0f, 0.0f)) {
+            for(int y = 0; y < size.y; y++)
+                for(int x = 0; x < size.x; x++)
+                    dataptr[rowStride * y + x] = color;
+        }
+
+        // Interleave the first 4 channels of source, canvas sizes have to match
+        void fromPlanar(FloatPointMatrixCollection& source) {
+            if(source.canvasSize() != size)
+                return;
+            std::vector<float> zero(size.x, 0.0f), one(size.x, 1.0f);
+            for(int y = 0; y < size.y; y++) {
+                const float* planes[FMCI_COMPONENTS];
+                for(int c = 0; c < FMCI_COMPONENTS; c++)
+                    planes[c] = c < source.count() ? source[c].rowPtr(y) : (c == 3 ? one.data() : zero.data());
+                SIMD::interleave4((float*)rowPtr(y), planes[0], planes[1], planes[2], planes[3], size.x);
+            }
+        }
+
+        // Split into the first 4 channels of target, canvas sizes have to match
+        void toPlanar(FloatPointMatrixCollection& target) const {
+            if(target.canvasSize() != size)
+                return;
+            std::vector<float> discard(size.x);
+            for(int y = 0; y < size.y; y++) {
+                float* planes[FMCI_COMPONENTS];
+                for(int c = 0; c < FMCI_COMPONENTS; c++)
+                    planes[c] = c < target.count() ? target[c].rowPtr(y) : discard.data();
+                SIMD::deinterleave4((const float*)rowPtr(y), planes[0], planes[1], planes[2], planes[3], size.x);
+            }
+        }
+
+        // Copy the content of source, canvas sizes have to match
+        void copyContent(const FloatPointMatrixCollectionInterleaved& source) {
+            if(source.canvasSize() != size)
+                return;
+            for(int y = 0; y < size.y; y++)
+                memcpy(rowPtr(y), source.rowPtr(y), sizeof(TileMode::Color) * size.x);
+        }
+
+    };
+
+    typedef FloatPointMatrixCollectionInterleaved FMCI;
+
+}
+
+#endif
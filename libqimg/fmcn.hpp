@@ -0,0 +1,491 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : fmcn.hpp
+//  Purpose     : Type of FloatPointMatrix Collection with a compile-time channel count
+//  License     : MIT License
+
+#ifndef _LIBQIMG_FMCN_HPP_
+#define _LIBQIMG_FMCN_HPP_
+
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <utility>
+
+#include "libqimg_debuglog.hpp"
+#include "libqimg_math.hpp"
+#include "point.hpp"
+#include "color.hpp"
+#include "fmat.hpp"
+#include "fmc.hpp"
+#include "fmci.hpp"
+
+namespace libqimg {
+
+    /*
+        Fixed Channel Count Collection
+        Same planar layout as FMC: N planes of one aligned block sharing the same row stride.
+        Channels are held in a fixed array instead of a pointer array, so loops over the channels
+        have a constant trip count and are unrolled by the compiler.
+        A pixel of all channels is a TileMode::Color, channel c is component c,
+        missing components are R G B = 0, A = 1 like FMCI.
+        Files are read and written in the .fmc format.
+    */
+
+    // Float Point Matrix Collection of N channels, N is 1 to 4
+    template <int N>
+    class FixedMatrixCollection {
+
+        static_assert(N >= 1 && N <= FMCI_COMPONENTS, "FixedMatrixCollection holds 1 to 4 channels");
+
+      private:
+        bool openSucceed = false;
+        Point size;
+        std::string channelTags[N];
+        FloatPointMatrix channels[N];
+        float* planes = nullptr;
+        size_t planeSize = 0;
+        int rowStride = 0;
+        // Returned by operator[] for tags not in the collection, every collection has its own
+        FloatPointMatrix missingChannel;
+
+        // Value of a channel the source does not have, a missing alpha channel is opaque
+        inline static float missingValue(int ch) { return ch == 3 ? 1.0f : 0.0f; }
+
+        // Allocate the plane block for the current size, channels become views onto it
+        void allocate() {
+            rowStride = FloatPointMatrix::paddedStride(size.x);
+            planeSize = (size_t)rowStride * size.y;
+            // Planes a multiple of 4 KiB apart would put a pixel of every channel into the same cache sets
+            if((planeSize * sizeof(float)) % FMAT_CACHE_ALIASING == 0)
+                planeSize += FMAT_ALIGNMENT_FLOATS;
+            planes = allocateAligned(planeSize * N);
+            for(int ch = 0; ch < N; ch++)
+                channels[ch] = FloatPointMatrix(planes + planeSize * ch, size, rowStride);
+        }
+
+        // Move the data of other into this empty collection, other is left empty
+        void take(FixedMatrixCollection& other) {
+            openSucceed = other.openSucceed;
+            size = other.size;
+            for(int ch = 0; ch < N; ch++) {
+                channelTags[ch] = std::move(other.channelTags[ch]);
+                channels[ch] = std::move(other.channels[ch]);
+            }
+            planes = other.planes;
+            planeSize = other.planeSize;
+            rowStride = other.rowStride;
+            other.openSucceed = false;
+            other.size = Point(0, 0);
+            other.planes = nullptr;
+            other.planeSize = 0;
+            other.rowStride = 0;
+        }
+
+      public:
+
+        // Empty collection, every channel is empty
+        FixedMatrixCollection():size(Point(0, 0)) {}
+
+        // Initialize a collection by size.
+        FixedMatrixCollection(Point size):size(size) {
+            allocate();
+            openSucceed = true;
+        }
+
+        // Initialize a collection by size.
+        FixedMatrixCollection(int sizeX, int sizeY):size(Point(sizeX, sizeY)) {
+            allocate();
+            openSucceed = true;
+        }
+
+        // Create from a collection of any channel count, see fromDynamic
+        explicit FixedMatrixCollection(FloatPointMatrixCollection& source):size(source.canvasSize()) {
+            allocate();
+            fromDynamic(source);
+            openSucceed = true;
+        }
+
+        // Read collection from a .fmc file, the first N channels are kept, missing channels are 0 and a missing alpha is 1
+        FixedMatrixCollection(std::string filename) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[FMCN \"%s\" ] Opening file \"%s\" ...\n", filename.data(), filename.data());
+#endif
+            auto file = std::ifstream(filename, std::ios::in | std::ios::binary);
+            if(!file) {
+#ifdef LIBQIMG_SHOWLOG
+                printf("[FMCN \"%s\" ] Cannot open file \"%s\" .\n", filename.data(), filename.data());
+#endif
+                return;
+            }
+            char header[16];
+            file.read(header, 14);
+            int fileSignature;
+            memcpy(&fileSignature, header, 4);
+            if(fileSignature == FMC_TYPED_SIGNATURE)
+                file.read(header + 14, 2);
+            unsigned short channelCount;
+            ElementType::ElementType fileType;
+            size_t offset;
+            if(!file || !readCollectionHeader(header, fileSignature == FMC_TYPED_SIGNATURE ? 16 : 14, size, channelCount, fileType, offset)) {
+#ifdef LIBQIMG_SHOWLOG
+                printf("[FMCN \"%s\" ] \"%s\"  signature incorrect.\n", filename.data(), filename.data());
+#endif
+                size = Point(0, 0);
+                return;
+            }
+            allocate();
+            for(int ch = 0; ch < N; ch++) {
+                if(ch >= channelCount) {
+                    channels[ch].erase(missingValue(ch));
+                    continue;
+                }
+                char tagTemp[256];
+                unsigned char tagLen;
+                file.read((char*)&tagLen, 1);
+                file.read(tagTemp, tagLen);
+                channelTags[ch] = std::string(tagTemp, tagLen);
+                if(!file || !channels[ch].readData(file, fileType)) {
+#ifdef LIBQIMG_SHOWLOG
+                    printf("[FMCN \"%s\" ] \"%s\"  is truncated.\n", filename.data(), filename.data());
+#endif
+                    dispose();
+                    return;
+                }
+            }
+            file.close();
+#ifdef LIBQIMG_SHOWLOG
+            printf("[FMCN \"%s\" ] File \"%s\"  loaded successfully.\n", filename.data(), filename.data());
+#endif
+            openSucceed = true;
+        }
+
+        // Save file in the .fmc format
+        bool save(std::string filename) {
+            auto file = std::ofstream(filename, std::ios::out | std::ios::binary);
+            if(!file) {
+#ifdef LIBQIMG_SHOWLOG
+                printf("[FMCN \"%s\" ] Cannot open file \"%s\" .\n", filename.data(), filename.data());
+#endif
+                return false;
+            }
+            unsigned short channelCount = N;
+            file.write((char*)&FMC_SIGNATURE, 4);
+            file.write((char*)&size, 8);
+            file.write((char*)&channelCount, 2);
+            for(int ch = 0; ch < N; ch++) {
+                unsigned char tagLen = channelTags[ch].length();
+                file.write((char*)&tagLen, 1);
+                file.write(channelTags[ch].data(), tagLen);
+                channels[ch].writeData(file);
+            }
+            file.close();
+#ifdef LIBQIMG_SHOWLOG
+            printf("[FMCN \"%s\" ] File \"%s\"  wrote successfully.\n", filename.data(), filename.data());
+#endif
+            return true;
+        }
+
+        // Collections own their data, copies are made by copy() or copyFrom()
+        FixedMatrixCollection(const FixedMatrixCollection&) = delete;
+        FixedMatrixCollection& operator=(const FixedMatrixCollection&) = delete;
+
+        // Take the data of other, other is left empty
+        FixedMatrixCollection(FixedMatrixCollection&& other) noexcept {
+            take(other);
+        }
+
+        // Free the data of this collection and take the data of other, other is left empty
+        FixedMatrixCollection& operator=(FixedMatrixCollection&& other) noexcept {
+            if(this != &other) {
+                dispose();
+                take(other);
+            }
+            return *this;
+        }
+
+        ~FixedMatrixCollection() { dispose(); }
+
+        // Free memory, the collection is left empty
+        void dispose() {
+            for(int ch = 0; ch < N; ch++)
+                channels[ch].dispose();
+            if(planes != nullptr)
+                freeAligned(planes);
+            planes = nullptr;
+            planeSize = 0;
+            rowStride = 0;
+            size = Point(0, 0);
+            openSucceed = false;
+        }
+
+        // Adjust the canvas size, keep the overlapping content.
+        void resizeCanvas(int sizeX, int sizeY) {
+            FixedMatrixCollection old = std::move(*this);
+            size = Point(sizeX, sizeY);
+            allocate();
+            for(int ch = 0; ch < N; ch++) {
+                channelTags[ch] = old.channelTags[ch];
+                for(int y = 0; y < math::min(old.size.y, size.y); y++)
+                    memcpy(channels[ch].rowPtr(y), old.channels[ch].rowPtr(y), sizeof(float) * math::min(old.size.x, size.x));
+            }
+            openSucceed = true;
+        }
+
+        /* Function same as FMC */
+        inline Point canvasSize() const { return size; }
+        inline int width() const { return size.x; }
+        inline int height() const { return size.y; }
+        // Return the channel count
+        static constexpr unsigned short count() { return N; }
+        inline std::string& channelName(unsigned short channelID) { return channelTags[channelID]; }
+
+        // Return true if every channel is a plane of the block returned by data()
+        inline bool planar() const { return planes != nullptr; }
+        // Return the first float of the plane block
+        inline float* data() { return planes; }
+        inline const float* data() const { return planes; }
+        // Return the distance between two planes in floats
+        inline size_t planeStride() const { return planeSize; }
+        // Return the distance between two rows of a plane in floats
+        inline int stride() const { return rowStride; }
+
+        inline float aspectRatio() const { return (float)size.x / (float)size.y; }
+
+        // Return the Point mapped from [-0.5 ~ size - 0.5] to [-1, 1]
+        inline PointF coordinate(PointF position) const {
+            return PointF::reverseLerp(
+                PointF(((float)size.x) / 2.0f, ((float)size.y) / 2.0f),
+                PointF((float)size.x, (float)size.y),
+                position);
+        }
+
+        // Return the Point mapped from [-0.5 ~ size - 0.5] to [-1, 1]
+        inline PointF coordinate(Point position) const {
+            return coordinate(PointF((float)position.x + 0.5f, (float)position.y + 0.5f));
+        }
+
+        // Return the pixel position of coordinate
+        inline PointF positionFloat(PointF coordinate) const {
+            return PointF::lerp(
+                PointF(((float)(size.x)) / 2.0f, ((float)(size.y)) / 2.0f),
+                PointF((float)(size.x), (float)(size.y)),
+                coordinate);
+        }
+
+        // Return the pixel position of coordinate
+        inline Point position(PointF coordinate) const {
+            return Point(PointF::lerp(
+                PointF(((float)(size.x)) / 2.0f, ((float)(size.y)) / 2.0f),
+                PointF((float)(size.x), (float)(size.y)),
+                coordinate - PointF(0.5f, 0.5f)));
+        }
+
+        // The left down corner point
+        Point end() const { return Point(size.x - 1, size.y - 1); }
+
+        inline FloatPointMatrix& operator[](int index) { return channels[index]; }
+        inline const FloatPointMatrix& operator[](int index) const { return channels[index]; }
+
+        FloatPointMatrix& operator[](std::string index) {
+            for(int ch = 0; ch < N; ch++)
+                if(index == channelTags[ch])
+                    return channels[ch];
+            // Misses return the empty matrix of this collection, it is emptied again in case it was written to
+            missingChannel = FloatPointMatrix();
+            return missingChannel;
+        }
+
+        // Return the channel ID
+        int indexOf(std::string index) {
+            for(int ch = 0; ch < N; ch++)
+                if(index == channelTags[ch])
+                    return ch;
+            return -1;
+        }
+
+        // Return a view of the rectangle from begin of regionSize in every channel, clipped to the canvas.
+        // Channels of the view share the data of this collection, it has to outlive the view.
+        FixedMatrixCollection view(Point begin, Point regionSize) {
+            FixedMatrixCollection ret;
+            ret.size = regionSize;
+            channels[0].clip(begin, ret.size);
+            for(int ch = 0; ch < N; ch++) {
+                ret.channels[ch] = channels[ch].view(begin, regionSize);
+                ret.channelTags[ch] = channelTags[ch];
+            }
+            ret.openSucceed = true;
+            return ret;
+        }
+
+        // Get every channel of a pixel in readonly mode, the tile mode is resolved at compile time
+        // Empty pixels are zero in every component, like an empty FMAT in every channel
+        template <TileMode::TileMode tileMode>
+        inline TileMode::Color pixelAccess(int x, int y) const {
+            if(!(x >= 0 && y >= 0 && x < size.x && y < size.y)) {
+                if constexpr (tileMode == TileMode::empty)
+                    return TileMode::Color(0.0f, 0.0f, 0.0f, 0.0f);
+                x = TileMode::resolve<tileMode>(x, size.x);
+                y = TileMode::resolve<tileMode>(y, size.y);
+            }
+            TileMode::Color pixel(0.0f, 0.0f, 0.0f, 1.0f);
+            float* component = &pixel.r;
+            for(int ch = 0; ch < N; ch++)
+                component[ch] = channels[ch].rowPtr(y)[x];
+            return pixel;
+        }
+
+        // Get every channel of a pixel in readonly mode
+        TileMode::Color pixelAccess(int x, int y, TileMode::TileMode tileMode = TileMode::clamp) const {
+            return TileMode::dispatch(tileMode, [&](auto tile) {
+                return pixelAccess<decltype(tile)::value>(x, y);
+            });
+        }
+
+        // Write the first N components of pixel, pixels out of the canvas are ignored
+        inline void setPixel(int x, int y, const TileMode::Color& pixel) {
+            if(x < 0 || y < 0 || x >= size.x || y >= size.y)
+                return;
+            const float* component = &pixel.r;
+            for(int ch = 0; ch < N; ch++)
+                channels[ch].rowPtr(y)[x] = component[ch];
+        }
+
+        // Sample all channels at pt, same positions and weights as FMAT::sample
+        template <SampleMode::SampleMode sampleMode, TileMode::TileMode tileMode>
+        inline TileMode::Color sample(PointF pt) const {
+            if constexpr (sampleMode == SampleMode::nearest)
+                return pixelAccess<tileMode>((int)floorf(pt.x), (int)floorf(pt.y));
+            else {
+                float fx = floorf(pt.x - 0.5f), fy = floorf(pt.y - 0.5f);
+                int x = (int)fx, y = (int)fy;
+                PointF t = PointF(pt.x - 0.5f - fx, pt.y - 0.5f - fy);
+                TileMode::Color u = TileMode::Color::lerp(pixelAccess<tileMode>(x, y), pixelAccess<tileMode>(x + 1, y), t.x);
+                TileMode::Color d = TileMode::Color::lerp(pixelAccess<tileMode>(x, y + 1), pixelAccess<tileMode>(x + 1, y + 1), t.x);
+                return TileMode::Color::lerp(u, d, t.y);
+            }
+        }
+
+        // Execute specific function at all position from begin to end, function parameters: (Point current, FixedMatrixCollection& collection)
+        template <class Function>
+        void canvasForeach(Function function, Point begin, Point end) {
+            for(int y = begin.y; y <= end.y; y++)
+                for(int x = begin.x; x <= end.x; x++)
+                    function(Point(x, y), *this);
+        };
+
+        // Execute specific function at all position, function parameters: (Point current, FixedMatrixCollection& collection)
+        template <class Function>
+        void canvasForeach(Function function) {
+            canvasForeach(function, Point(0, 0), end());
+        };
+
+        // Execute specific function at all position from begin to end, function parameters: (Point current, unsigned short channelID, FixedMatrixCollection& collection, FloatPointMatrix& matrix)
+        template <class Function>
+        void channelForeach(Function function, Point begin, Point end) {
+            for(int ch = 0; ch < N; ch++)
+                for(int y = begin.y; y <= end.y; y++)
+                    for(int x = begin.x; x <= end.x; x++)
+                        function(Point(x, y), ch, *this, channels[ch]);
+        };
+
+        // Execute specific function at all position, function parameters: (Point current, unsigned short channelID, FixedMatrixCollection& collection, FloatPointMatrix& matrix)
+        template <class Function>
+        void channelForeach(Function function) {
+            channelForeach(function, Point(0, 0), end());
+        };
+
+        // Copy the channels of a collection of any channel count, canvas sizes have to match.
+        // The first N channels and their tags are copied, channels source does not have are 0, a missing alpha is 1.
+        void fromDynamic(FloatPointMatrixCollection& source) {
+            if(source.canvasSize() != size)
+                return;
+            for(int ch = 0; ch < N; ch++) {
+                if(ch < source.count()) {
+                    channels[ch].copyContent(source[ch]);
+                    channelTags[ch] = source.channelName(ch);
+                } else
+                    channels[ch].erase(missingValue(ch));
+            }
+        }
+
+        // Copy the channels into a collection of any channel count, canvas sizes have to match.
+        // Channels beyond N are left untouched.
+        void toDynamic(FloatPointMatrixCollection& target) {
+            if(target.canvasSize() != size)
+                return;
+            for(int ch = 0; ch < math::min(N, (int)target.count()); ch++) {
+                target[ch].copyContent(channels[ch]);
+                target.channelName(ch) = channelTags[ch];
+            }
+        }
+
+        // Create a collection of N channels holding a copy of this one
+        FloatPointMatrixCollection toDynamic() {
+            FloatPointMatrixCollection ret = FloatPointMatrixCollection(size, N);
+            toDynamic(ret);
+            return ret;
+        }
+
+        // Copy matrix size
+        void copyCanvas(FixedMatrixCollection& source) {
+            dispose();
+            size = source.canvasSize();
+            allocate();
+            for(int ch = 0; ch < N; ch++)
+                channelTags[ch] = source.channelName(ch);
+            openSucceed = true;
+        }
+
+        // Copy content
+        void copyContent(FixedMatrixCollection& source) {
+            // Same layout, the whole block is copied at once
+            if(planar() && source.planar() && source.canvasSize() == size &&
+               source.stride() == rowStride && source.planeStride() == planeSize) {
+                memcpy(planes, source.data(), sizeof(float) * planeSize * N);
+                return;
+            }
+            for(int ch = 0; ch < N; ch++)
+                channels[ch].copyContent(source[ch]);
+        }
+
+        // Exchange the planes with other, return false if the layouts differ.
+        // Channel tags stay, nothing is copied.
+        bool swapContent(FixedMatrixCollection& other) {
+            if(!planar() || !other.planar() || other.canvasSize() != size ||
+               other.stride() != rowStride || other.planeStride() != planeSize)
+                return false;
+            std::swap(planes, other.planes);
+            for(int ch = 0; ch < N; ch++)
+                std::swap(channels[ch], other.channels[ch]);
+            return true;
+        }
+
+        // Copy collection from source
+        void copyFrom(FixedMatrixCollection& source) {
+            copyCanvas(source);
+            copyContent(source);
+        }
+
+        // Create new object and copy from source
+        static FixedMatrixCollection copy(FixedMatrixCollection& source) {
+            FixedMatrixCollection ret = FixedMatrixCollection(source.canvasSize());
+            for(int ch = 0; ch < N; ch++)
+                ret.channelTags[ch] = source.channelName(ch);
+            ret.copyContent(source);
+            return ret;
+        }
+
+    };
+
+    // Float Point Matrix Collection of N channels
+    template <int N>
+    using FMCN = FixedMatrixCollection<N>;
+    typedef FixedMatrixCollection<1> FMC1;
+    typedef FixedMatrixCollection<2> FMC2;
+    typedef FixedMatrixCollection<3> FMC3;
+    typedef FixedMatrixCollection<4> FMC4;
+
+}
+
+#endif
@@ -15,8 +15,16 @@
 #include "tilemode.hpp"
 #include "color.hpp"
 #include "point.hpp"
+#include "fileMapping.hpp"
+#include "element.hpp"
 #include "fmat.hpp"
 #include "fmc.hpp"
+#include "fmci.hpp"
+#include "fmcn.hpp"
 #include "multiThread.hpp"
+#include "simd.hpp"
+#include "random.hpp"
+#include "matrixPool.hpp"
+#include "summedAreaTable.hpp"
 
 #endif
\ No newline at end of file
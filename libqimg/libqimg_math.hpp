@@ -28,8 +28,8 @@ namespace libqimg::math {
     }
     // Mod function that supports negative x
     inline int mod(int x, int mod) {
-        if(x >= 0) return x % mod;
-        else return (x - ((1 + x / mod) * mod)) % mod;
+        int result = x % mod;
+        return result < 0 ? result + mod : result;
     }
 
 }
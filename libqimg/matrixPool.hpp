@@ -0,0 +1,206 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : matrixPool.hpp
+//  Purpose     : Reuse scratch matrices between effects
+//  License     : MIT License
+
+#ifndef _LIBQIMG_MATRIXPOOL_HPP_
+#define _LIBQIMG_MATRIXPOOL_HPP_
+
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "libqimg_debuglog.hpp"
+#include "libqimg_math.hpp"
+#include "point.hpp"
+#include "fmat.hpp"
+
+namespace libqimg {
+
+    /*
+        Matrix Pool
+        Released blocks are kept in buckets of the same capacity and handed out again,
+        so a loop running the same effects on the same sizes stops allocating after its first pass.
+        Capacities are rounded up to 1/16 of their power of 2, a block serves every request up to its capacity.
+        The capacity is stored in the FMAT_ALIGNMENT bytes in front of the block.
+    */
+
+    // Counters of a MatrixPool
+    struct MatrixPoolStats {
+        // Requests served by a cached block
+        size_t hits = 0;
+        // Requests allocated from the heap
+        size_t misses = 0;
+        // Bytes handed out and not released yet
+        size_t bytesInUse = 0;
+        // Bytes of released blocks kept for reuse
+        size_t bytesCached = 0;
+        // Highest bytesInUse + bytesCached, the memory taken from the heap at once
+        size_t peakBytes = 0;
+    };
+
+    class MatrixPool {
+
+      private:
+        std::mutex mutex;
+        std::map<size_t, std::vector<float*>> buckets;
+        MatrixPoolStats counters;
+        size_t cacheLimit;
+
+        // Round count up to its bucket, in floats
+        inline static size_t bucketCapacity(size_t count) {
+            size_t step = FMAT_ALIGNMENT_FLOATS;
+            while(step * 16 < count)
+                step *= 2;
+            return (count + step - 1) / step * step;
+        }
+
+        inline static size_t& capacityOf(float* data) {
+            return *(size_t*)(data - FMAT_ALIGNMENT_FLOATS);
+        }
+
+      public:
+
+        // Released blocks beyond cacheLimit bytes are freed instead of cached
+        MatrixPool(size_t cacheLimit = (size_t)1 << 30):cacheLimit(cacheLimit) {}
+
+        ~MatrixPool() { trim(); }
+
+        // Return an aligned block of at least count floats
+        float* allocate(size_t count) {
+            size_t capacity = bucketCapacity(math::max(count, (size_t)1));
+            size_t bytes = capacity * sizeof(float);
+            std::lock_guard<std::mutex> lock(mutex);
+            float* data = nullptr;
+            auto bucket = buckets.find(capacity);
+            if(bucket != buckets.end() && !bucket->second.empty()) {
+                data = bucket->second.back();
+                bucket->second.pop_back();
+                counters.bytesCached -= bytes;
+                counters.hits++;
+            } else {
+                data = allocateAligned(capacity + FMAT_ALIGNMENT_FLOATS) + FMAT_ALIGNMENT_FLOATS;
+                capacityOf(data) = capacity;
+                counters.misses++;
+#ifdef LIBQIMG_SHOWLOG
+                printf("[MatrixPool] Allocated %zu bytes.\n", bytes);
+#endif
+            }
+            counters.bytesInUse += bytes;
+            counters.peakBytes = math::max(counters.peakBytes, counters.bytesInUse + counters.bytesCached);
+            return data;
+        }
+
+        // Give a block from allocate back to the pool
+        void free(float* data) {
+            if(data == nullptr)
+                return;
+            size_t capacity = capacityOf(data);
+            size_t bytes = capacity * sizeof(float);
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.bytesInUse -= bytes;
+            if(counters.bytesCached + bytes > cacheLimit) {
+                freeAligned(data - FMAT_ALIGNMENT_FLOATS);
+                return;
+            }
+            buckets[capacity].push_back(data);
+            counters.bytesCached += bytes;
+        }
+
+        // Return a matrix of size on a pooled block, it has to be given back by release instead of dispose
+        FloatPointMatrix acquire(Point size) {
+            if(size.x <= 0 || size.y <= 0)
+                return FloatPointMatrix();
+            int stride = FloatPointMatrix::paddedStride(size.x);
+            return FloatPointMatrix(allocate((size_t)stride * size.y), size, stride);
+        }
+
+        // Give a matrix from acquire back to the pool
+        void release(FloatPointMatrix& matrix) {
+            if(matrix.canvasSize().x > 0 && matrix.canvasSize().y > 0)
+                free(matrix.rowPtr(0));
+            matrix = FloatPointMatrix();
+        }
+
+        // Free every cached block
+        void trim() {
+            std::lock_guard<std::mutex> lock(mutex);
+            for(auto& bucket : buckets)
+                for(float* data : bucket.second)
+                    freeAligned(data - FMAT_ALIGNMENT_FLOATS);
+            buckets.clear();
+            counters.bytesCached = 0;
+        }
+
+        MatrixPoolStats stats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return counters;
+        }
+
+        // Clear the hit and miss counters, peakBytes restarts from the current usage
+        void resetStats() {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.hits = 0;
+            counters.misses = 0;
+            counters.peakBytes = counters.bytesInUse + counters.bytesCached;
+        }
+
+    };
+
+    // Pool of the scratch matrices of effects
+    MatrixPool matrixPool;
+
+    // Matrices borrowed from a pool for a scope, they are all given back when the arena is destroyed
+    class MatrixArena {
+
+      private:
+        static const int INLINE_BLOCKS = 8;
+        MatrixPool& pool;
+        float* blocks[INLINE_BLOCKS];
+        int blockCount = 0;
+        // Blocks beyond INLINE_BLOCKS
+        std::vector<float*> overflow;
+
+      public:
+
+        MatrixArena(MatrixPool& pool = matrixPool):pool(pool) {}
+        MatrixArena(const MatrixArena&) = delete;
+        MatrixArena& operator=(const MatrixArena&) = delete;
+
+        ~MatrixArena() { release(); }
+
+        // Return a scratch matrix of size, valid until the arena is released
+        FloatPointMatrix acquire(Point size) {
+            FloatPointMatrix matrix = pool.acquire(size);
+            if(size.x <= 0 || size.y <= 0)
+                return matrix;
+            if(blockCount < INLINE_BLOCKS)
+                blocks[blockCount++] = matrix.rowPtr(0);
+            else
+                overflow.push_back(matrix.rowPtr(0));
+            return matrix;
+        }
+
+        // Return a scratch copy of source
+        FloatPointMatrix copy(FloatPointMatrix& source) {
+            FloatPointMatrix matrix = acquire(source.canvasSize());
+            matrix.copyContent(source);
+            return matrix;
+        }
+
+        // Give every matrix back to the pool
+        void release() {
+            for(int i = 0; i < blockCount; i++)
+                pool.free(blocks[i]);
+            for(float* data : overflow)
+                pool.free(data);
+            blockCount = 0;
+            overflow.clear();
+        }
+
+    };
+
+}
+
+#endif
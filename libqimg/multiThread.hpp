@@ -1,4 +1,3 @@
-
 //  Copyright 2021 Isoheptane
 //  Filename    : mutliThread.hpp
 //  Purpose     : Support Mulit Thread Tasks
@@ -9,315 +8,667 @@
 
 #include <iostream>
 #include <cstring>
-#include <pthread.h>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <initializer_list>
 
 #include "libqimg_debuglog.hpp"
 #include "fmat.hpp"
 #include "fmc.hpp"
+#include "fmci.hpp"
+#include "fmcn.hpp"
 
 namespace libqimg::MultiThread {
 
-    int defaultThreadCount = 8;
+    int defaultThreadCount = math::max((int)std::thread::hardware_concurrency(), 1);
+    // Smallest amount of pixels worth a task of its own
+    int minPixelsPerTask = 4096;
 
     /*
-        FMC TaskBlock MultiThread
+        Thread Pool
     */
-    
-    template <class Function>
-    struct FMCTaskBlock {
-
-        FMC* collection;
-        Point begin, end;
-        Function* function;
-        std::string taskName;
-        int threadId;
-        bool* completed;
-        
-        FMCTaskBlock(
-            FMC* collection, 
-            Point begin, 
-            Point end, 
-            Function* function, 
-            std::string taskName, 
-            int tid,
-            bool* completePtr
-        ):  collection(collection), 
-            begin(begin), 
-            end(end), 
-            function(function), 
-            taskName(taskName), 
-            threadId(tid),
-            completed(completePtr) {}
 
+    // A single queued job, calls entry(context) on a worker thread.
+    struct PoolJob {
+        void (*entry)(void*);
+        void* context;
     };
 
-    #define FMC_CANVAS_MTEXEC_PARAMS FMC_CANVAS_FOREACH_PARAMS
+    // Long-lived worker threads shared by every multi-thread execution.
+    class ThreadPool {
+      private:
+        std::vector<std::thread> workers;
+        // Ring of queued jobs, it only grows, so queueing does not allocate once it is large enough
+        std::vector<PoolJob> jobs;
+        size_t jobFront = 0, jobCount = 0;
+        std::mutex mutex;
+        std::condition_variable wakeup;
+        bool stopping = false;
+
+        void pushJob(PoolJob job) {
+            if(jobCount == jobs.size()) {
+                std::vector<PoolJob> grown(math::max(jobs.size() * 2, (size_t)64));
+                for(size_t i = 0; i < jobCount; i++)
+                    grown[i] = jobs[(jobFront + i) % jobs.size()];
+                jobs.swap(grown);
+                jobFront = 0;
+            }
+            jobs[(jobFront + jobCount) % jobs.size()] = job;
+            jobCount++;
+        }
 
-    // Execute a single FMCTaskBlock
-    template <class Function> void* executeFMCTaskBlockCanvas(void* importArgs) {
-        FMCTaskBlock<Function>* taskBlock = (FMCTaskBlock<Function>*) importArgs;
-#ifdef LIBQIMG_SHOWLOG    
-        printf("[Task \"%s\" #% 3d ] Begin execution.\n", 
-            taskBlock->taskName.data(), 
-            taskBlock->threadId);
-#endif
-        taskBlock->collection->canvasForeach(
-            *taskBlock->function,
-            taskBlock->begin, 
-            taskBlock->end
-        );
-        *taskBlock->completed = true;
-#ifdef LIBQIMG_SHOWLOG    
-        printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n",
-            taskBlock->taskName.data(), 
-            taskBlock->threadId);
-#endif
-        delete taskBlock;
-        pthread_exit(NULL);
-    }
+        PoolJob popJob() {
+            PoolJob job = jobs[jobFront];
+            jobFront = (jobFront + 1) % jobs.size();
+            jobCount--;
+            return job;
+        }
 
-    #define FMC_CHANNEL_MTEXEC_PARAMS FMC_CHANNEL_FOREACH_PARAMS
+        void workerLoop() {
+            while(true) {
+                PoolJob job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    wakeup.wait(lock, [this] { return stopping || jobCount > 0; });
+                    if(stopping && jobCount == 0) return;
+                    job = popJob();
+                }
+                job.entry(job.context);
+            }
+        }
+      public:
 
-    // Execute a single FMCTaskBlock
-    template <class Function> void* executeFMCTaskBlockChannel(void* importArgs) {
-        FMCTaskBlock<Function>* taskBlock = (FMCTaskBlock<Function>*) importArgs;
-#ifdef LIBQIMG_SHOWLOG    
-        printf("[Task \"%s\" #% 3d ] Begin execution.\n", 
-            taskBlock->taskName.data(), 
-            taskBlock->threadId);
-#endif
-        taskBlock->collection->channelForeach(
-            *taskBlock->function,
-            taskBlock->begin, 
-            taskBlock->end
-        );
-        *taskBlock->completed = true;
-#ifdef LIBQIMG_SHOWLOG    
-        printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n",
-            taskBlock->taskName.data(), 
-            taskBlock->threadId);
-#endif
-        delete taskBlock;
-        pthread_exit(NULL);
+        // Start workerCount worker threads.
+        ThreadPool(int workerCount) {
+            for(int i = 0; i < workerCount; i++)
+                workers.emplace_back([this] { workerLoop(); });
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wakeup.notify_all();
+            for(auto& worker : workers)
+                worker.join();
+        }
+
+        // Return the worker thread count
+        inline int size() const { return (int)workers.size(); }
+
+        // Queue a job, it will be executed by any idle worker.
+        void submit(PoolJob job) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pushJob(job);
+            }
+            wakeup.notify_one();
+        }
+
+        // Execute one queued job on the calling thread. Return false if there is no queued job.
+        bool runPending() {
+            PoolJob job;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(jobCount == 0) return false;
+                job = popJob();
+            }
+            job.entry(job.context);
+            return true;
+        }
+
+    };
+
+    // The shared thread pool, created on first use and sized from the hardware.
+    ThreadPool& threadPool() {
+        static ThreadPool pool(math::max((int)std::thread::hardware_concurrency() - 1, 1));
+        return pool;
     }
 
+    // Blocking barrier, wait() returns after arrive() has been called for every task.
+    class TaskBarrier {
+      private:
+        int remaining;
+        std::mutex mutex;
+        std::condition_variable done;
+      public:
+
+        TaskBarrier(int taskCount):remaining(taskCount) {}
+
+        void arrive() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(--remaining == 0)
+                done.notify_all();
+        }
+
+        // Block until every task arrived. Queued jobs are executed while waiting,
+        // so nested executions never wait on jobs nobody is going to run.
+        void wait() {
+            while(true) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if(remaining == 0) return;
+                }
+                if(!threadPool().runPending()) break;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            done.wait(lock, [this] { return remaining == 0; });
+        }
+
+    };
+
     /*
-        FMAT TaskBlock MultiThread
+        Work Stealing Parallel For
     */
 
-    template <class Function>
-    struct FMATTaskBlock {
+    // Upper bound of threads taking part in a single execution
+    const int MTEXEC_MAX_PARTICIPANTS = 64;
+
+    // Slot of the calling thread in the innermost parallelFor it is running tasks of
+    inline int& threadSlot() {
+        static thread_local int slot = 0;
+        return slot;
+    }
+
+    // Return the slot of the calling thread in the parallelFor running the current task.
+    // Slots are below maxParticipants(threadCount) and no two threads share one during an execution,
+    // so per-thread scratch memory can be taken once per call and indexed by slot.
+    inline int currentSlot() { return threadSlot(); }
+
+    // Upper bound of threads taking part in an execution of threadCount
+    inline int maxParticipants(int threadCount = defaultThreadCount) {
+        return math::max(math::min(threadCount, math::min(threadPool().size() + 1, MTEXEC_MAX_PARTICIPANTS)), 1);
+    }
+
+    // Range of task indices owned by one participant, packed as (back << 32 | front).
+    // The owner pops from the front, idle participants steal from the back.
+    struct alignas(64) TaskRange {
+        std::atomic<unsigned long long> range;
+
+        static inline unsigned long long pack(int front, int back) {
+            return ((unsigned long long)(unsigned int)back << 32) | (unsigned int)front;
+        }
 
-        FMAT* matrix;
-        Point begin, end;
+        void assign(int front, int back) { range.store(pack(front, back)); }
+
+        bool popFront(int& task) {
+            unsigned long long current = range.load();
+            while(true) {
+                int front = (int)(current & 0xFFFFFFFFull), back = (int)(current >> 32);
+                if(front >= back) return false;
+                if(range.compare_exchange_weak(current, pack(front + 1, back))) {
+                    task = front;
+                    return true;
+                }
+            }
+        }
+
+        bool stealBack(int& task) {
+            unsigned long long current = range.load();
+            while(true) {
+                int front = (int)(current & 0xFFFFFFFFull), back = (int)(current >> 32);
+                if(front >= back) return false;
+                if(range.compare_exchange_weak(current, pack(front, back - 1))) {
+                    task = back - 1;
+                    return true;
+                }
+            }
+        }
+    };
+
+    template <class Function>
+    struct ParallelForContext {
         Function* function;
-        std::string taskName;
-        int threadId;
-        bool* completed;
-        
-        FMATTaskBlock(
-            FMAT* matrix, 
-            Point begin, 
-            Point end, 
-            Function* function, 
-            std::string taskName, 
-            int tid,
-            bool* completePtr
-        ):  matrix(matrix), 
-            begin(begin), 
-            end(end), 
-            function(function), 
-            taskName(taskName), 
-            threadId(tid),
-            completed(completePtr) {}
+        int participantCount;
+        std::atomic<int> nextSlot;
+        TaskRange ranges[MTEXEC_MAX_PARTICIPANTS];
+        TaskBarrier barrier;
+
+        ParallelForContext(Function* function, int taskCount, int participantCount):
+            function(function),
+            participantCount(participantCount),
+            nextSlot(0),
+            barrier(participantCount - 1) {
+            // Hand out contiguous ranges so neighbouring tasks stay on one thread
+            for(int i = 0; i < participantCount; i++)
+                ranges[i].assign(
+                    (int)((long long)taskCount * i / participantCount),
+                    (int)((long long)taskCount * (i + 1) / participantCount));
+        }
 
+        // Run own tasks, then steal from the others until every range is empty
+        void drain() {
+            int slot = nextSlot++;
+            int outerSlot = threadSlot();
+            threadSlot() = slot;
+            int task;
+            while(ranges[slot].popFront(task))
+                (*function)(task);
+            for(int i = 1; i < participantCount; i++) {
+                TaskRange& victim = ranges[(slot + i) % participantCount];
+                while(victim.stealBack(task))
+                    (*function)(task);
+            }
+            threadSlot() = outerSlot;
+        }
     };
 
-    #define FMAT_MTEXEC_PARAMS FMAT_PARAMETERIZED_FOREACH_PARAMS
+    template <class Function> void executeParallelForHelper(void* importArgs) {
+        ParallelForContext<Function>* context = (ParallelForContext<Function>*) importArgs;
+        context->drain();
+        context->barrier.arrive();
+    }
 
-    // Execute a single FMATTaskBlock
-    template <class Function> void* executeFMATTaskBlock(void* importArgs) {
-        FMATTaskBlock<Function>* taskBlock = (FMATTaskBlock<Function>*) importArgs;
-#ifdef LIBQIMG_SHOWLOG    
-        printf("[Task \"%s\" #% 3d ] Begin execution.\n", 
-            taskBlock->taskName.data(), 
-            taskBlock->threadId);
-#endif
-        taskBlock->matrix->parameterizedForeach(
-            *taskBlock->function, 
-            taskBlock->begin, 
-            taskBlock->end
-        );
-        *taskBlock->completed = true;
-#ifdef LIBQIMG_SHOWLOG    
-        printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n",
-            taskBlock->taskName.data(), 
-            taskBlock->threadId);
-#endif
-        delete taskBlock;
-        pthread_exit(NULL);
+    // Execute function(taskIndex) for every taskIndex in [0, taskCount) on the thread pool.
+    // The calling thread takes part in the execution and returns when all tasks finished.
+    template <class Function> void parallelFor(
+        int taskCount,
+        Function function,
+        int threadCount = defaultThreadCount
+    ) {
+        int participantCount = math::min(maxParticipants(threadCount), taskCount);
+        if(participantCount <= 1) {
+            int outerSlot = threadSlot();
+            threadSlot() = 0;
+            for(int i = 0; i < taskCount; i++)
+                function(i);
+            threadSlot() = outerSlot;
+            return;
+        }
+        ParallelForContext<Function> context(&function, taskCount, participantCount);
+        for(int i = 1; i < participantCount; i++)
+            threadPool().submit((PoolJob){ executeParallelForHelper<Function>, &context });
+        context.drain();
+        context.barrier.wait();
+    }
+
+    /*
+        Tile Execution
+    */
+
+    // Tile size used to split the canvas. A component <= 0 is planned from the amount of work:
+    // about 4 tiles per thread, no tile smaller than minPixelsPerTask, rows split first.
+    Point defaultGrainSize = Point(0, 0);
+
+    // Split a canvas into 2D tiles of grain size, tiles are numbered in row-major order
+    struct TileGrid {
+        Point canvas, grain;
+        int columns, rows;
+
+        // layers is the amount of canvases a tile covers, e.g. the channel count of a span execution.
+        // It only raises the work of a tile, the tile count is still capped by the thread count.
+        TileGrid(Point canvas, Point grain, int threadCount, int layers = 1):canvas(canvas), grain(grain) {
+            long long pixels = (long long)math::max(canvas.x, 1) * math::max(canvas.y, 1);
+            long long taskCount = math::min(
+                (long long)math::max(threadCount, 1) * 4,
+                pixels * math::max(layers, 1) / math::max(minPixelsPerTask, 1));
+            taskCount = math::max(taskCount, 1ll);
+            // Prefer full rows, split columns only if rows are not enough
+            int tileRows = (int)math::min(taskCount, (long long)math::max(canvas.y, 1));
+            int tileColumns = (int)math::min(
+                (taskCount + tileRows - 1) / tileRows,
+                (long long)math::max(canvas.x, 1));
+            if(this->grain.x <= 0)
+                this->grain.x = math::max((canvas.x + tileColumns - 1) / tileColumns, 1);
+            if(this->grain.y <= 0)
+                this->grain.y = math::max((canvas.y + tileRows - 1) / tileRows, 1);
+            columns = (canvas.x + this->grain.x - 1) / this->grain.x;
+            rows = (canvas.y + this->grain.y - 1) / this->grain.y;
+        }
+
+        inline int count() const { return columns * rows; }
+
+        inline Point begin(int tile) const {
+            return Point((tile % columns) * grain.x, (tile / columns) * grain.y);
+        }
+
+        inline Point end(int tile) const {
+            Point b = begin(tile);
+            return Point(
+                math::min(b.x + grain.x, canvas.x) - 1,
+                math::min(b.y + grain.y, canvas.y) - 1);
+        }
+    };
+
+    // Width of the column bands for tasks that walk whole columns, planned like TileGrid:
+    // about 4 bands per thread, no band smaller than minPixelsPerTask, none wider than maxWidth.
+    // Bands are kept to whole alignment units unless the canvas is too narrow for that.
+    inline int columnBandWidth(Point canvas, int threadCount, int maxWidth) {
+        int width = math::max(canvas.x, 1);
+        long long pixels = (long long)width * math::max(canvas.y, 1);
+        long long bandCount = math::min(
+            (long long)math::max(threadCount, 1) * 4,
+            pixels / math::max(minPixelsPerTask, 1));
+        bandCount = math::max(math::min(bandCount, (long long)width), 1ll);
+        int bandWidth = (int)((width + bandCount - 1) / bandCount);
+        if(bandWidth > FMAT_ALIGNMENT_FLOATS)
+            bandWidth = (bandWidth + FMAT_ALIGNMENT_FLOATS - 1) / FMAT_ALIGNMENT_FLOATS * FMAT_ALIGNMENT_FLOATS;
+        return math::clamp(bandWidth, 1, math::max(maxWidth, 1));
     }
 
+    #define FMC_CANVAS_MTEXEC_PARAMS FMC_CANVAS_FOREACH_PARAMS
+    #define FMC_CHANNEL_MTEXEC_PARAMS FMC_CHANNEL_FOREACH_PARAMS
+    #define FMAT_MTEXEC_PARAMS FMAT_PARAMETERIZED_FOREACH_PARAMS
+
     /*
         mtFunction
     */
 
-    #define MTEXEC_PARAMS int threadCount = MultiThread::defaultThreadCount, std::string taskName = "$anonymous"
+    #define MTEXEC_PARAMS int threadCount = MultiThread::defaultThreadCount, [[maybe_unused]] std::string taskName = "$anonymous"
 
     // Execute function on multi cores, may highly improve performance.
+    // The canvas is split into tiles of grain size, idle threads steal queued tiles.
+    // Small canvases are executed on the calling thread, always return true.
     template <class Function> bool multiThreadExecuteCanvas(
-        FMC& collection, 
-        Function function, 
-        std::string taskName = "$anonymous", 
-        int threadCount = defaultThreadCount
+        FMC& collection,
+        Function function,
+        [[maybe_unused]] std::string taskName = "$anonymous",
+        int threadCount = defaultThreadCount,
+        Point grain = defaultGrainSize
     ) {
 
-        // Check if able to chunk
-        if(collection.width() < threadCount || collection.height() < threadCount) {
-#ifdef LIBQIMG_SHOWLOG    
-            printf("[Task \"%s\" #### ] Denied execution. Collection size too small.\n", 
-                taskName.data());
-#endif      
-            return false;
-        }
-        pthread_t threads[threadCount];
-        bool completed[threadCount];
-        for(int i = 0; i < threadCount; i++)
-            completed[i] = false;
-        int cur = 0;
-        int step = collection.height() / threadCount;
-        // Create threads
-        for(int i = 0; i < threadCount; i++) {
-            if(i != threadCount - 1) {
-                pthread_create(&threads[i], NULL, executeFMCTaskBlockCanvas<Function>, 
-                    new FMCTaskBlock<Function>(&collection,
-                        Point(0, cur), Point(collection.width() - 1, cur + step - 1),
-                        &function, taskName, i, &completed[i]
-                    ));
-            } else {
-                pthread_create(&threads[i], NULL, executeFMCTaskBlockCanvas<Function>, 
-                    new FMCTaskBlock<Function>(&collection,
-                        Point(0, cur), collection.end(),
-                        &function, taskName, i, &completed[i]
-                    ));
-            }
-            cur += step;
-        }
-        // Wait unitl complete
-        while(true) {
-            bool allCompleted = true;
-            for(int i = 0; i < threadCount; i++)
-                if(!completed[i]) allCompleted = false;
-            if(allCompleted) break;
-            else std::this_thread::yield();
-        }
+        TileGrid grid(collection.canvasSize(), grain, threadCount);
+        parallelFor(grid.count(), [&](int tile) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ] Begin execution.\n", taskName.data(), tile);
+#endif
+            collection.canvasForeach(function, grid.begin(tile), grid.end(tile));
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n", taskName.data(), tile);
+#endif
+        }, threadCount);
         return true;
     }
 
+    // Execute function on multi cores, may highly improve performance.
+    // The canvas is split into tiles of grain size, idle threads steal queued tiles.
+    // Small canvases are executed on the calling thread, always return true.
+    template <class Function> bool multiThreadExecuteChannel(
+        FMC& collection,
+        Function function,
+        [[maybe_unused]] std::string taskName = "$anonymous",
+        int threadCount = defaultThreadCount,
+        Point grain = defaultGrainSize
+    ) {
 
+        // Tasks are split across channels as well as across the canvas,
+        // so the tiles of a channel are planned for its share of the threads
+        int channelCount = math::max((int)collection.count(), 1);
+        TileGrid grid(collection.canvasSize(), grain, (threadCount + channelCount - 1) / channelCount);
+        parallelFor(grid.count() * collection.count(), [&](int tile) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ] Begin execution.\n", taskName.data(), tile);
+#endif
+            collection.channelForeach(function, tile / grid.count(),
+                grid.begin(tile % grid.count()), grid.end(tile % grid.count()));
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n", taskName.data(), tile);
+#endif
+        }, threadCount);
+        return true;
+    }
 
     // Execute function on multi cores, may highly improve performance.
-    template <class Function> bool multiThreadExecuteChannel(
-        FMC& collection, 
-        Function function, 
-        std::string taskName = "$anonymous", 
-        int threadCount = defaultThreadCount
+    // The canvas is split into tiles of grain size, idle threads steal queued tiles.
+    // Small canvases are executed on the calling thread, always return true.
+    template <typename T, class Function> bool multiThreadExecute(
+        Matrix<T>& matrix,
+        Function function,
+        [[maybe_unused]] std::string taskName = "$anonymous",
+        int threadCount = defaultThreadCount,
+        Point grain = defaultGrainSize
     ) {
 
-        // Check if able to chunk
-        if(collection.width() < threadCount || collection.height() < threadCount) {
-#ifdef LIBQIMG_SHOWLOG    
-            printf("[Task \"%s\" #### ] Denied execution. Collection size too small.\n", 
-                taskName.data());
-#endif      
+        TileGrid grid(matrix.canvasSize(), grain, threadCount);
+        parallelFor(grid.count(), [&](int tile) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ] Begin execution.\n", taskName.data(), tile);
+#endif
+            matrix.parameterizedForeach(function, grid.begin(tile), grid.end(tile));
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n", taskName.data(), tile);
+#endif
+        }, threadCount);
+        return true;
+    }
+
+
+    /*
+        Span Execution
+    */
+
+    // Span functions rarely need every parameter, the unused ones do not warn
+    #define FMAT_SPAN_PARAMS [[maybe_unused]] float* row, [[maybe_unused]] const float* const* sources, [[maybe_unused]] int y, int begin, int end
+
+    // Upper bound of source matrices passed to a span function, span executions given more return false without running
+    const int MTEXEC_MAX_SPAN_SOURCES = 8;
+
+    // Execute function on every row segment of matrix, function parameters: (float* row, const float* const* sources, int y, int begin, int end)
+    // row and sources[i] point to row y of matrix and of each source, the function has to process x in [begin, end).
+    // Sources must have the same canvas size as matrix. row is a T* for matrices of another element type.
+    template <typename T, class Function> bool multiThreadExecuteSpan(
+        Matrix<T>& matrix,
+        std::initializer_list<FMAT*> sources,
+        Function function,
+        [[maybe_unused]] std::string taskName = "$anonymous",
+        int threadCount = defaultThreadCount,
+        Point grain = defaultGrainSize
+    ) {
+
+        FMAT* sourceList[MTEXEC_MAX_SPAN_SOURCES];
+        if(sources.size() > (size_t)MTEXEC_MAX_SPAN_SOURCES) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" ] Too many span sources, %zu given, %d allowed.\n", taskName.data(), sources.size(), MTEXEC_MAX_SPAN_SOURCES);
+#endif
             return false;
         }
-        pthread_t threads[threadCount];
-        bool completed[threadCount];
-        for(int i = 0; i < threadCount; i++)
-            completed[i] = false;
-        int cur = 0;
-        int step = collection.height() / threadCount;
-        // Create threads
-        for(int i = 0; i < threadCount; i++) {
-            if(i != threadCount - 1) {
-                pthread_create(&threads[i], NULL, executeFMCTaskBlockChannel<Function>, 
-                    new FMCTaskBlock<Function>(&collection,
-                        Point(0, cur), Point(collection.width() - 1, cur + step - 1),
-                        &function, taskName, i, &completed[i]
-                    ));
-            } else {
-                pthread_create(&threads[i], NULL, executeFMCTaskBlockChannel<Function>, 
-                    new FMCTaskBlock<Function>(&collection,
-                        Point(0, cur), collection.end(),
-                        &function, taskName, i, &completed[i]
-                    ));
+        int sourceCount = 0;
+        for(FMAT* source : sources)
+            sourceList[sourceCount++] = source;
+        TileGrid grid(matrix.canvasSize(), grain, threadCount);
+        parallelFor(grid.count(), [&](int tile) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ] Begin execution.\n", taskName.data(), tile);
+#endif
+            Point begin = grid.begin(tile), end = grid.end(tile);
+            const float* rows[MTEXEC_MAX_SPAN_SOURCES];
+            for(int y = begin.y; y <= end.y; y++) {
+                for(int i = 0; i < sourceCount; i++)
+                    rows[i] = sourceList[i]->rowPtr(y);
+                function(matrix.rowPtr(y), (const float* const*)rows, y, begin.x, end.x + 1);
             }
-            cur += step;
-        }
-        // Wait unitl complete
-        while(true) {
-            bool allCompleted = true;
-            for(int i = 0; i < threadCount; i++)
-                if(!completed[i]) allCompleted = false;
-            if(allCompleted) break;
-            else std::this_thread::yield();
-        }
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n", taskName.data(), tile);
+#endif
+        }, threadCount);
         return true;
     }
 
-
-    // Execute function on multi cores, may highly improve performance.
-    template <class Function> bool multiThreadExecute(
-        FMAT& matrix, 
-        Function function, 
-        std::string taskName = "$anonymous", 
-        int threadCount = defaultThreadCount
+    #define FMC_SPAN_PARAMS [[maybe_unused]] const float* const* sources, [[maybe_unused]] int y, int begin, int end
+
+    // Execute function on every row segment of a collection canvas, function parameters: (const float* const* sources, int y, int begin, int end)
+    // Every channel of the segment is left to the function, sources[i] point to row y of each source.
+    template <class Function> bool multiThreadExecuteSpan(
+        FMC& collection,
+        std::initializer_list<FMAT*> sources,
+        Function function,
+        [[maybe_unused]] std::string taskName = "$anonymous",
+        int threadCount = defaultThreadCount,
+        Point grain = defaultGrainSize
     ) {
 
-        // Check if able to chunk
-        if(matrix.width() < threadCount || matrix.height() < threadCount) {
-#ifdef LIBQIMG_SHOWLOG    
-            printf("[Task \"%s\" #### ] Denied execution. Matrix size too small.\n", 
-                taskName.data());
+        FMAT* sourceList[MTEXEC_MAX_SPAN_SOURCES];
+        if(sources.size() > (size_t)MTEXEC_MAX_SPAN_SOURCES) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" ] Too many span sources, %zu given, %d allowed.\n", taskName.data(), sources.size(), MTEXEC_MAX_SPAN_SOURCES);
 #endif
             return false;
         }
-        pthread_t threads[threadCount];
-        bool completed[threadCount];
-        for(int i = 0; i < threadCount; i++)
-            completed[i] = false;
-        int cur = 0;
-        int step = matrix.height() / threadCount;
-        // Create threads
-        for(int i = 0; i < threadCount; i++) {
-            if(i != threadCount - 1) {
-                pthread_create(&threads[i], NULL, executeFMATTaskBlock<Function>, 
-                    new FMATTaskBlock<Function>(&matrix,
-                        Point(0, cur), Point(matrix.width() - 1, cur + step - 1),
-                        &function, (char*)taskName.data(), i, &completed[i]
-                    ));
-            } else {
-                pthread_create(&threads[i], NULL, executeFMATTaskBlock<Function>, 
-                    new FMATTaskBlock<Function>(&matrix,
-                        Point(0, cur), matrix.end(),
-                        &function, (char*)taskName.data(), i, &completed[i]
-                    ));
+        int sourceCount = 0;
+        for(FMAT* source : sources)
+            sourceList[sourceCount++] = source;
+        TileGrid grid(collection.canvasSize(), grain, threadCount, collection.count());
+        parallelFor(grid.count(), [&](int tile) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ] Begin execution.\n", taskName.data(), tile);
+#endif
+            Point begin = grid.begin(tile), end = grid.end(tile);
+            const float* rows[MTEXEC_MAX_SPAN_SOURCES];
+            for(int y = begin.y; y <= end.y; y++) {
+                for(int i = 0; i < sourceCount; i++)
+                    rows[i] = sourceList[i]->rowPtr(y);
+                function((const float* const*)rows, y, begin.x, end.x + 1);
             }
-            cur += step;
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n", taskName.data(), tile);
+#endif
+        }, threadCount);
+        return true;
+    }
+
+    #define FMCI_SPAN_PARAMS TileMode::Color* row, [[maybe_unused]] const float* const* sources, [[maybe_unused]] int y, int begin, int end
+
+    // Execute function on every row segment of an interleaved collection,
+    // function parameters: (TileMode::Color* row, const float* const* sources, int y, int begin, int end)
+    template <class Function> bool multiThreadExecuteSpan(
+        FMCI& collection,
+        std::initializer_list<FMAT*> sources,
+        Function function,
+        [[maybe_unused]] std::string taskName = "$anonymous",
+        int threadCount = defaultThreadCount,
+        Point grain = defaultGrainSize
+    ) {
+
+        FMAT* sourceList[MTEXEC_MAX_SPAN_SOURCES];
+        if(sources.size() > (size_t)MTEXEC_MAX_SPAN_SOURCES) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" ] Too many span sources, %zu given, %d allowed.\n", taskName.data(), sources.size(), MTEXEC_MAX_SPAN_SOURCES);
+#endif
+            return false;
         }
-        // Wait unitl complete
-        while(true) {
-            bool allCompleted = true;
-            for(int i = 0; i < threadCount; i++)
-                if(!completed[i]) allCompleted = false;
-            if(allCompleted) break;
-            else std::this_thread::yield();
+        int sourceCount = 0;
+        for(FMAT* source : sources)
+            sourceList[sourceCount++] = source;
+        TileGrid grid(collection.canvasSize(), grain, threadCount);
+        parallelFor(grid.count(), [&](int tile) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ] Begin execution.\n", taskName.data(), tile);
+#endif
+            Point begin = grid.begin(tile), end = grid.end(tile);
+            const float* rows[MTEXEC_MAX_SPAN_SOURCES];
+            for(int y = begin.y; y <= end.y; y++) {
+                for(int i = 0; i < sourceCount; i++)
+                    rows[i] = sourceList[i]->rowPtr(y);
+                function(collection.rowPtr(y), (const float* const*)rows, y, begin.x, end.x + 1);
+            }
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n", taskName.data(), tile);
+#endif
+        }, threadCount);
+        return true;
+    }
+
+    #define FMCN_SPAN_PARAMS float* const* rows, [[maybe_unused]] const float* const* sources, [[maybe_unused]] int y, int begin, int end
+
+    // Execute function on every row segment of a fixed channel count collection,
+    // function parameters: (float* const* rows, const float* const* sources, int y, int begin, int end)
+    // rows[ch] points to row y of channel ch, sources[i] to row y of each source.
+    template <int N, class Function> bool multiThreadExecuteSpan(
+        FixedMatrixCollection<N>& collection,
+        std::initializer_list<FMAT*> sources,
+        Function function,
+        [[maybe_unused]] std::string taskName = "$anonymous",
+        int threadCount = defaultThreadCount,
+        Point grain = defaultGrainSize
+    ) {
+
+        FMAT* sourceList[MTEXEC_MAX_SPAN_SOURCES];
+        if(sources.size() > (size_t)MTEXEC_MAX_SPAN_SOURCES) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" ] Too many span sources, %zu given, %d allowed.\n", taskName.data(), sources.size(), MTEXEC_MAX_SPAN_SOURCES);
+#endif
+            return false;
         }
+        int sourceCount = 0;
+        for(FMAT* source : sources)
+            sourceList[sourceCount++] = source;
+        TileGrid grid(collection.canvasSize(), grain, threadCount, N);
+        parallelFor(grid.count(), [&](int tile) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ] Begin execution.\n", taskName.data(), tile);
+#endif
+            Point begin = grid.begin(tile), end = grid.end(tile);
+            const float* rows[MTEXEC_MAX_SPAN_SOURCES];
+            float* channelRows[N];
+            for(int y = begin.y; y <= end.y; y++) {
+                for(int i = 0; i < sourceCount; i++)
+                    rows[i] = sourceList[i]->rowPtr(y);
+                for(int ch = 0; ch < N; ch++)
+                    channelRows[ch] = collection[ch].rowPtr(y);
+                function((float* const*)channelRows, (const float* const*)rows, y, begin.x, end.x + 1);
+            }
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n", taskName.data(), tile);
+#endif
+        }, threadCount);
+        return true;
+    }
+
+    /*
+        Split Execution
+    */
+
+    #define FMAT_SPLIT_PARAMS float* row, int y, int begin, int end
+
+    // Execute interior on the row segments inside [interiorBegin, interiorEnd) and border on every other segment,
+    // function parameters: (float* row, int y, int begin, int end), row points to row y of matrix, x in [begin, end) has to be processed.
+    // interior can index the neighbours directly, only border has to care about the edges.
+    template <class Interior, class Border> bool multiThreadExecuteSplit(
+        FMAT& matrix,
+        Point interiorBegin,
+        Point interiorEnd,
+        Interior interior,
+        Border border,
+        [[maybe_unused]] std::string taskName = "$anonymous",
+        int threadCount = defaultThreadCount,
+        Point grain = defaultGrainSize
+    ) {
+
+        Point canvas = matrix.canvasSize();
+        int x0 = math::clamp(interiorBegin.x, 0, canvas.x), x1 = math::clamp(interiorEnd.x, x0, canvas.x);
+        int y0 = math::clamp(interiorBegin.y, 0, canvas.y), y1 = math::clamp(interiorEnd.y, y0, canvas.y);
+        TileGrid grid(canvas, grain, threadCount);
+        parallelFor(grid.count(), [&](int tile) {
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ] Begin execution.\n", taskName.data(), tile);
+#endif
+            Point begin = grid.begin(tile), end = grid.end(tile);
+            for(int y = begin.y; y <= end.y; y++) {
+                float* row = matrix.rowPtr(y);
+                int b = begin.x, e = end.x + 1;
+                if(y < y0 || y >= y1) {
+                    border(row, y, b, e);
+                    continue;
+                }
+                int ib = math::clamp(x0, b, e), ie = math::clamp(x1, ib, e);
+                if(b < ib) border(row, y, b, ib);
+                if(ib < ie) interior(row, y, ib, ie);
+                if(ie < e) border(row, y, ie, e);
+            }
+#ifdef LIBQIMG_SHOWLOG
+            printf("[Task \"%s\" #% 3d ]  -> Execution completed.\n", taskName.data(), tile);
+#endif
+        }, threadCount);
         return true;
     }
 
 }
 
-#endif
\ No newline at end of file
+#endif
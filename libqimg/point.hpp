@@ -72,6 +72,9 @@ namespace libqimg {
         inline Point operator+=(const Point& b) { return (*this) = (Point){x + b.x, y + b.y}; }
         inline Point operator-=(const Point& b) { return (*this) = (Point){x - b.x, y - b.y}; }
         inline Point operator*=(int b) { return (*this) = (Point){x * b, y * b}; }
+        /* Comparison operators */
+        inline bool operator==(const Point& b) const { return x == b.x && y == b.y; }
+        inline bool operator!=(const Point& b) const { return x != b.x || y != b.y; }
 
     };
 
@@ -0,0 +1,133 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : random.hpp
+//  Purpose     : Counter-based random numbers
+//  License     : MIT License
+
+#ifndef _LIBQIMG_RANDOM_HPP_
+#define _LIBQIMG_RANDOM_HPP_
+
+#include <cstdint>
+
+#include "libqimg_math.hpp"
+#include "simd.hpp"
+
+namespace libqimg::Random {
+
+    /*
+        Philox4x32-10 (Salmon et al., 2011)
+        A pure function of a 128-bit counter and a 64-bit key, there is no state to share between threads.
+        Pixel (x, y) takes word x % 4 of counter (x / 4, y, 0, 0), so any pixel can be generated alone
+        and a row span gives the same values whatever way it is split.
+    */
+
+    const uint32_t PHILOX_M0 = 0xD2511F53;
+    const uint32_t PHILOX_M1 = 0xCD9E8D57;
+    const uint32_t PHILOX_W0 = 0x9E3779B9;
+    const uint32_t PHILOX_W1 = 0xBB67AE85;
+    // Counter blocks generated together by the bulk fill
+    const int RANDOM_BATCH = 16;
+
+    // Generator key, the seed and the stream, e.g. the channel
+    struct Key {
+        uint32_t seed, stream;
+        explicit Key(uint32_t seed, uint32_t stream = 0):seed(seed), stream(stream) {}
+    };
+
+    // Transform counter in place into 4 random words
+    inline void philox(uint32_t counter[4], Key key) {
+        uint32_t k0 = key.seed, k1 = key.stream;
+        for(int round = 0; round < 10; round++) {
+            uint64_t p0 = (uint64_t)PHILOX_M0 * counter[0];
+            uint64_t p1 = (uint64_t)PHILOX_M1 * counter[2];
+            counter[0] = (uint32_t)(p1 >> 32) ^ counter[1] ^ k0;
+            counter[1] = (uint32_t)p1;
+            counter[2] = (uint32_t)(p0 >> 32) ^ counter[3] ^ k1;
+            counter[3] = (uint32_t)p0;
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+    }
+
+    // Map a random word to [0, 1)
+    inline float unitFloat(uint32_t word) {
+        return (float)(word >> 8) * (1.0f / 16777216.0f);
+    }
+
+    // Return the uniform random value in [0, 1) of pixel (x, y)
+    inline float uniform(Key key, int x, int y) {
+        uint32_t counter[4] = { (uint32_t)x >> 2, (uint32_t)y, 0, 0 };
+        philox(counter, key);
+        return unitFloat(counter[(uint32_t)x & 3]);
+    }
+
+    // RANDOM_BATCH consecutive blocks of row y from block first, words[lane * 4 + i] is word i of block first + lane.
+    // Lanes are kept in separate arrays so the rounds vectorize.
+    _LIBQIMG_SIMD_INLINE_ void philoxBatch(uint32_t* words, uint32_t first, uint32_t y, Key key) {
+        uint32_t c0[RANDOM_BATCH], c1[RANDOM_BATCH], c2[RANDOM_BATCH], c3[RANDOM_BATCH];
+        for(int lane = 0; lane < RANDOM_BATCH; lane++) {
+            c0[lane] = first + lane;
+            c1[lane] = y;
+            c2[lane] = 0;
+            c3[lane] = 0;
+        }
+        uint32_t k0 = key.seed, k1 = key.stream;
+        for(int round = 0; round < 10; round++) {
+            for(int lane = 0; lane < RANDOM_BATCH; lane++) {
+                uint64_t p0 = (uint64_t)PHILOX_M0 * c0[lane];
+                uint64_t p1 = (uint64_t)PHILOX_M1 * c2[lane];
+                c0[lane] = (uint32_t)(p1 >> 32) ^ c1[lane] ^ k0;
+                c1[lane] = (uint32_t)p1;
+                c2[lane] = (uint32_t)(p0 >> 32) ^ c3[lane] ^ k1;
+                c3[lane] = (uint32_t)p0;
+            }
+            k0 += PHILOX_W0;
+            k1 += PHILOX_W1;
+        }
+        for(int lane = 0; lane < RANDOM_BATCH; lane++) {
+            words[lane * 4] = c0[lane];
+            words[lane * 4 + 1] = c1[lane];
+            words[lane * 4 + 2] = c2[lane];
+            words[lane * 4 + 3] = c3[lane];
+        }
+    }
+
+#ifdef _LIBQIMG_SIMD_X86_
+    __attribute__((target("avx2")))
+    inline void philoxBatchAVX2(uint32_t* words, uint32_t first, uint32_t y, Key key) {
+        philoxBatch(words, first, y, key);
+    }
+
+    __attribute__((target("avx512f")))
+    inline void philoxBatchAVX512(uint32_t* words, uint32_t first, uint32_t y, Key key) {
+        philoxBatch(words, first, y, key);
+    }
+#endif
+
+    // Fill out[0, count) with the values of pixels (x, y) to (x + count - 1, y), scaled to [min, max)
+    // Only the integer rounds use the wider instruction sets, so the result is the same on every CPU.
+    inline void fillUniform(float* out, int x, int y, int count, Key key, float min = 0.0f, float max = 1.0f) {
+        uint32_t words[RANDOM_BATCH * 4];
+        uint32_t position = (uint32_t)x;
+        SIMDLevel::SIMDLevel level = SIMD::level();
+        int done = 0;
+        while(done < count) {
+            uint32_t offset = position & 3;
+#ifdef _LIBQIMG_SIMD_X86_
+            if(level >= SIMDLevel::avx512)
+                philoxBatchAVX512(words, position >> 2, (uint32_t)y, key);
+            else if(level >= SIMDLevel::avx2)
+                philoxBatchAVX2(words, position >> 2, (uint32_t)y, key);
+            else
+#endif
+                philoxBatch(words, position >> 2, (uint32_t)y, key);
+            int length = math::min(count - done, RANDOM_BATCH * 4 - (int)offset);
+            for(int i = 0; i < length; i++)
+                out[done + i] = math::lerp(min, max, unitFloat(words[offset + i]));
+            done += length;
+            position += length;
+        }
+    }
+
+}
+
+#endif
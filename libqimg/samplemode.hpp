@@ -7,6 +7,9 @@
 #ifndef _LIBQIMG_SAMPLEMODE_HPP_
 #define _LIBQIMG_SAMPLEMODE_HPP_
 
+#include <cmath>
+#include <type_traits>
+
 #include "libqimg_math.hpp"
 #include "point.hpp"
 
@@ -15,7 +18,11 @@ namespace libqimg::SampleMode {
     // Sample Mode selection
     enum SampleMode {
         nearest = 0,
-        bilinear = 1
+        bilinear = 1,
+        // Keys cubic, a = -0.5, 4 taps
+        bicubic = 2,
+        // Lanczos with 3 lobes, 6 taps
+        lanczos = 3
     };
     
     float nearestSample(float lu, float ru, float ld, float rd, PointF t) {
@@ -30,6 +37,52 @@ namespace libqimg::SampleMode {
         return math::lerp(u, d, t.y);
     }
 
+    // Amount of source pixels a filter reads along one axis
+    inline int filterTaps(SampleMode sampleMode) {
+        switch (sampleMode) {
+            case bilinear: return 2;
+            case bicubic: return 4;
+            case lanczos: return 6;
+            default: return 1;
+        }
+    }
+
+    // Filter weight of a source pixel at distance x
+    inline float filterWeight(SampleMode sampleMode, float x) {
+        x = fabsf(x);
+        switch (sampleMode) {
+            case bilinear:
+                return x < 1.0f ? 1.0f - x : 0.0f;
+            case bicubic: {
+                const float a = -0.5f;
+                if(x < 1.0f) return ((a + 2.0f) * x - (a + 3.0f)) * x * x + 1.0f;
+                if(x < 2.0f) return ((a * x - 5.0f * a) * x + 8.0f * a) * x - 4.0f * a;
+                return 0.0f;
+            }
+            case lanczos: {
+                if(x < 1e-6f) return 1.0f;
+                if(x >= 3.0f) return 0.0f;
+                float px = (float)M_PI * x;
+                return 3.0f * sinf(px) * sinf(px / 3.0f) / (px * px);
+            }
+            default:
+                return x < 0.5f ? 1.0f : 0.0f;
+        }
+    }
+
+    // Call function once with the sample mode as a compile-time constant: function(std::integral_constant<SampleMode, mode>())
+    // Unknown modes are dispatched as nearest. Point samplers read 2x2 pixels, so bicubic and lanczos are dispatched as bilinear,
+    // only the separable resampler uses their wider filters.
+    template <class Function>
+    inline decltype(auto) dispatch(SampleMode sampleMode, Function&& function) {
+        switch (sampleMode) {
+            case bilinear:
+            case bicubic:
+            case lanczos: return function(std::integral_constant<SampleMode, bilinear>());
+            default: return function(std::integral_constant<SampleMode, nearest>());
+        }
+    }
+
 }
 
 #endif
\ No newline at end of file
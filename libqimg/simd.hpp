@@ -0,0 +1,515 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : simd.hpp
+//  Purpose     : Support SIMD row kernels with runtime CPU dispatch
+//  License     : MIT License
+
+#ifndef _LIBQIMG_SIMD_HPP_
+#define _LIBQIMG_SIMD_HPP_
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define _LIBQIMG_SIMD_X86_
+#include <immintrin.h>
+#endif
+
+// Bodies shared by several instruction sets are inlined into each target function, so each copy is vectorized for it
+#if defined(__GNUC__) || defined(__clang__)
+#define _LIBQIMG_SIMD_INLINE_ __attribute__((always_inline)) inline
+#else
+#define _LIBQIMG_SIMD_INLINE_ inline
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "libqimg_debuglog.hpp"
+
+namespace libqimg::SIMDLevel {
+
+    // Instruction set selection
+    enum SIMDLevel {
+        // Plain C++, the reference path
+        scalar = 0,
+        // 4 floats per instruction
+        sse42 = 1,
+        // 8 floats per instruction, with FMA
+        avx2 = 2,
+        // 16 floats per instruction
+        avx512 = 3
+    };
+
+}
+
+namespace libqimg::SIMD {
+
+    // Highest instruction set the row kernels may use, lower it to force a path
+    SIMDLevel::SIMDLevel simdLevelLimit = SIMDLevel::avx512;
+
+    // Return the highest instruction set supported by the CPU
+    inline SIMDLevel::SIMDLevel detectLevel() {
+#ifdef _LIBQIMG_SIMD_X86_
+        static const SIMDLevel::SIMDLevel detected = []() {
+            __builtin_cpu_init();
+            if(__builtin_cpu_supports("avx512f"))
+                return SIMDLevel::avx512;
+            if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+                return SIMDLevel::avx2;
+            if(__builtin_cpu_supports("sse4.2"))
+                return SIMDLevel::sse42;
+            return SIMDLevel::scalar;
+        }();
+        return detected;
+#else
+        return SIMDLevel::scalar;
+#endif
+    }
+
+    // Return the instruction set the row kernels will use
+    inline SIMDLevel::SIMDLevel level() {
+        SIMDLevel::SIMDLevel detected = detectLevel();
+        return detected < simdLevelLimit ? detected : simdLevelLimit;
+    }
+
+    /*
+        Row Kernels
+        rowTaps    : out[i] = sum of taps[t] * in[i + t]
+        columnTaps : out[i] = sum of taps[t] * in[t * lineStride + i]
+        Every path sums the taps of an output in the same order, the scalar path is the reference of the others.
+        AVX2 and AVX-512 fuse each multiply and add into one rounding, and compilers may contract the scalar
+        and SSE4.2 loops the same way, so paths agree within float rounding of the sum, not bit for bit.
+    */
+
+    inline void rowTapsScalar(float* out, const float* in, int count, const float* taps, int tapCount, bool accumulate) {
+        for(int i = 0; i < count; i++) {
+            float sum = accumulate ? out[i] : 0.0f;
+            for(int t = 0; t < tapCount; t++)
+                sum += taps[t] * in[i + t];
+            out[i] = sum;
+        }
+    }
+
+    inline void columnTapsScalar(float* out, const float* in, size_t lineStride, int count, const float* taps, int tapCount) {
+        for(int i = 0; i < count; i++) {
+            float sum = 0.0f;
+            for(int t = 0; t < tapCount; t++)
+                sum += taps[t] * in[(size_t)t * lineStride + i];
+            out[i] = sum;
+        }
+    }
+
+    /*
+        Layout Conversion
+        interleave4   : out[i * 4 + c] = planes[c][i]
+        deinterleave4 : planes[c][i] = in[i * 4 + c]
+        Values are only moved, so every path gives the same result.
+    */
+
+    inline void interleave4Scalar(float* out, const float* r, const float* g, const float* b, const float* a, int count) {
+        for(int i = 0; i < count; i++) {
+            out[i * 4] = r[i];
+            out[i * 4 + 1] = g[i];
+            out[i * 4 + 2] = b[i];
+            out[i * 4 + 3] = a[i];
+        }
+    }
+
+    inline void deinterleave4Scalar(const float* in, float* r, float* g, float* b, float* a, int count) {
+        for(int i = 0; i < count; i++) {
+            r[i] = in[i * 4];
+            g[i] = in[i * 4 + 1];
+            b[i] = in[i * 4 + 2];
+            a[i] = in[i * 4 + 3];
+        }
+    }
+
+#ifdef _LIBQIMG_SIMD_X86_
+
+    // SSE4.2, two vectors of 4 outputs per step
+    __attribute__((target("sse4.2")))
+    inline void rowTapsSSE42(float* out, const float* in, int count, const float* taps, int tapCount, bool accumulate) {
+        int i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m128 a = accumulate ? _mm_loadu_ps(out + i) : _mm_setzero_ps();
+            __m128 b = accumulate ? _mm_loadu_ps(out + i + 4) : _mm_setzero_ps();
+            for(int t = 0; t < tapCount; t++) {
+                __m128 w = _mm_set1_ps(taps[t]);
+                a = _mm_add_ps(a, _mm_mul_ps(w, _mm_loadu_ps(in + i + t)));
+                b = _mm_add_ps(b, _mm_mul_ps(w, _mm_loadu_ps(in + i + t + 4)));
+            }
+            _mm_storeu_ps(out + i, a);
+            _mm_storeu_ps(out + i + 4, b);
+        }
+        rowTapsScalar(out + i, in + i, count - i, taps, tapCount, accumulate);
+    }
+
+    __attribute__((target("sse4.2")))
+    inline void columnTapsSSE42(float* out, const float* in, size_t lineStride, int count, const float* taps, int tapCount) {
+        int i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m128 a = _mm_setzero_ps(), b = _mm_setzero_ps();
+            for(int t = 0; t < tapCount; t++) {
+                __m128 w = _mm_set1_ps(taps[t]);
+                a = _mm_add_ps(a, _mm_mul_ps(w, _mm_loadu_ps(in + (size_t)t * lineStride + i)));
+                b = _mm_add_ps(b, _mm_mul_ps(w, _mm_loadu_ps(in + (size_t)t * lineStride + i + 4)));
+            }
+            _mm_storeu_ps(out + i, a);
+            _mm_storeu_ps(out + i + 4, b);
+        }
+        for(; i < count; i++) {
+            float sum = 0.0f;
+            for(int t = 0; t < tapCount; t++)
+                sum += taps[t] * in[(size_t)t * lineStride + i];
+            out[i] = sum;
+        }
+    }
+
+    // AVX2, two vectors of 8 outputs per step
+    __attribute__((target("avx2,fma")))
+    inline void rowTapsAVX2(float* out, const float* in, int count, const float* taps, int tapCount, bool accumulate) {
+        int i = 0;
+        for(; i + 16 <= count; i += 16) {
+            __m256 a = accumulate ? _mm256_loadu_ps(out + i) : _mm256_setzero_ps();
+            __m256 b = accumulate ? _mm256_loadu_ps(out + i + 8) : _mm256_setzero_ps();
+            for(int t = 0; t < tapCount; t++) {
+                __m256 w = _mm256_set1_ps(taps[t]);
+                a = _mm256_fmadd_ps(w, _mm256_loadu_ps(in + i + t), a);
+                b = _mm256_fmadd_ps(w, _mm256_loadu_ps(in + i + t + 8), b);
+            }
+            _mm256_storeu_ps(out + i, a);
+            _mm256_storeu_ps(out + i + 8, b);
+        }
+        rowTapsSSE42(out + i, in + i, count - i, taps, tapCount, accumulate);
+    }
+
+    __attribute__((target("avx2,fma")))
+    inline void columnTapsAVX2(float* out, const float* in, size_t lineStride, int count, const float* taps, int tapCount) {
+        int i = 0;
+        for(; i + 16 <= count; i += 16) {
+            __m256 a = _mm256_setzero_ps(), b = _mm256_setzero_ps();
+            for(int t = 0; t < tapCount; t++) {
+                __m256 w = _mm256_set1_ps(taps[t]);
+                a = _mm256_fmadd_ps(w, _mm256_loadu_ps(in + (size_t)t * lineStride + i), a);
+                b = _mm256_fmadd_ps(w, _mm256_loadu_ps(in + (size_t)t * lineStride + i + 8), b);
+            }
+            _mm256_storeu_ps(out + i, a);
+            _mm256_storeu_ps(out + i + 8, b);
+        }
+        for(; i < count; i++) {
+            float sum = 0.0f;
+            for(int t = 0; t < tapCount; t++)
+                sum += taps[t] * in[(size_t)t * lineStride + i];
+            out[i] = sum;
+        }
+    }
+
+    // AVX-512, two vectors of 16 outputs per step
+    __attribute__((target("avx512f")))
+    inline void rowTapsAVX512(float* out, const float* in, int count, const float* taps, int tapCount, bool accumulate) {
+        int i = 0;
+        for(; i + 32 <= count; i += 32) {
+            __m512 a = accumulate ? _mm512_loadu_ps(out + i) : _mm512_setzero_ps();
+            __m512 b = accumulate ? _mm512_loadu_ps(out + i + 16) : _mm512_setzero_ps();
+            for(int t = 0; t < tapCount; t++) {
+                __m512 w = _mm512_set1_ps(taps[t]);
+                a = _mm512_fmadd_ps(w, _mm512_loadu_ps(in + i + t), a);
+                b = _mm512_fmadd_ps(w, _mm512_loadu_ps(in + i + t + 16), b);
+            }
+            _mm512_storeu_ps(out + i, a);
+            _mm512_storeu_ps(out + i + 16, b);
+        }
+        // Remaining outputs are masked, nothing past count is read or written
+        for(; i < count; i += 16) {
+            __mmask16 mask = count - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - i)) - 1);
+            __m512 a = accumulate ? _mm512_maskz_loadu_ps(mask, out + i) : _mm512_setzero_ps();
+            for(int t = 0; t < tapCount; t++)
+                a = _mm512_fmadd_ps(_mm512_set1_ps(taps[t]), _mm512_maskz_loadu_ps(mask, in + i + t), a);
+            _mm512_mask_storeu_ps(out + i, mask, a);
+        }
+    }
+
+    __attribute__((target("avx512f")))
+    inline void columnTapsAVX512(float* out, const float* in, size_t lineStride, int count, const float* taps, int tapCount) {
+        int i = 0;
+        for(; i + 32 <= count; i += 32) {
+            __m512 a = _mm512_setzero_ps(), b = _mm512_setzero_ps();
+            for(int t = 0; t < tapCount; t++) {
+                __m512 w = _mm512_set1_ps(taps[t]);
+                a = _mm512_fmadd_ps(w, _mm512_loadu_ps(in + (size_t)t * lineStride + i), a);
+                b = _mm512_fmadd_ps(w, _mm512_loadu_ps(in + (size_t)t * lineStride + i + 16), b);
+            }
+            _mm512_storeu_ps(out + i, a);
+            _mm512_storeu_ps(out + i + 16, b);
+        }
+        for(; i < count; i += 16) {
+            __mmask16 mask = count - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - i)) - 1);
+            __m512 a = _mm512_setzero_ps();
+            for(int t = 0; t < tapCount; t++)
+                a = _mm512_fmadd_ps(_mm512_set1_ps(taps[t]), _mm512_maskz_loadu_ps(mask, in + (size_t)t * lineStride + i), a);
+            _mm512_mask_storeu_ps(out + i, mask, a);
+        }
+    }
+
+    // SSE4.2, a 4x4 transpose per 4 pixels
+    __attribute__((target("sse4.2")))
+    inline void interleave4SSE42(float* out, const float* r, const float* g, const float* b, const float* a, int count) {
+        int i = 0;
+        for(; i + 4 <= count; i += 4) {
+            __m128 rg0 = _mm_unpacklo_ps(_mm_loadu_ps(r + i), _mm_loadu_ps(g + i));
+            __m128 rg1 = _mm_unpackhi_ps(_mm_loadu_ps(r + i), _mm_loadu_ps(g + i));
+            __m128 ba0 = _mm_unpacklo_ps(_mm_loadu_ps(b + i), _mm_loadu_ps(a + i));
+            __m128 ba1 = _mm_unpackhi_ps(_mm_loadu_ps(b + i), _mm_loadu_ps(a + i));
+            _mm_storeu_ps(out + i * 4, _mm_movelh_ps(rg0, ba0));
+            _mm_storeu_ps(out + i * 4 + 4, _mm_movehl_ps(ba0, rg0));
+            _mm_storeu_ps(out + i * 4 + 8, _mm_movelh_ps(rg1, ba1));
+            _mm_storeu_ps(out + i * 4 + 12, _mm_movehl_ps(ba1, rg1));
+        }
+        interleave4Scalar(out + i * 4, r + i, g + i, b + i, a + i, count - i);
+    }
+
+    __attribute__((target("sse4.2")))
+    inline void deinterleave4SSE42(const float* in, float* r, float* g, float* b, float* a, int count) {
+        int i = 0;
+        for(; i + 4 <= count; i += 4) {
+            __m128 p0 = _mm_loadu_ps(in + i * 4);
+            __m128 p1 = _mm_loadu_ps(in + i * 4 + 4);
+            __m128 p2 = _mm_loadu_ps(in + i * 4 + 8);
+            __m128 p3 = _mm_loadu_ps(in + i * 4 + 12);
+            _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+            _mm_storeu_ps(r + i, p0);
+            _mm_storeu_ps(g + i, p1);
+            _mm_storeu_ps(b + i, p2);
+            _mm_storeu_ps(a + i, p3);
+        }
+        deinterleave4Scalar(in + i * 4, r + i, g + i, b + i, a + i, count - i);
+    }
+
+    // AVX2, two 4x4 transposes side by side per 8 pixels
+    __attribute__((target("avx2")))
+    inline void interleave4AVX2(float* out, const float* r, const float* g, const float* b, const float* a, int count) {
+        int i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m256 vr = _mm256_loadu_ps(r + i), vg = _mm256_loadu_ps(g + i);
+            __m256 vb = _mm256_loadu_ps(b + i), va = _mm256_loadu_ps(a + i);
+            __m256 rg0 = _mm256_unpacklo_ps(vr, vg), rg1 = _mm256_unpackhi_ps(vr, vg);
+            __m256 ba0 = _mm256_unpacklo_ps(vb, va), ba1 = _mm256_unpackhi_ps(vb, va);
+            // Pixels 0 and 4, 1 and 5, 2 and 6, 3 and 7
+            __m256 p04 = _mm256_shuffle_ps(rg0, ba0, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 p15 = _mm256_shuffle_ps(rg0, ba0, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 p26 = _mm256_shuffle_ps(rg1, ba1, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 p37 = _mm256_shuffle_ps(rg1, ba1, _MM_SHUFFLE(3, 2, 3, 2));
+            _mm256_storeu_ps(out + i * 4, _mm256_permute2f128_ps(p04, p15, 0x20));
+            _mm256_storeu_ps(out + i * 4 + 8, _mm256_permute2f128_ps(p26, p37, 0x20));
+            _mm256_storeu_ps(out + i * 4 + 16, _mm256_permute2f128_ps(p04, p15, 0x31));
+            _mm256_storeu_ps(out + i * 4 + 24, _mm256_permute2f128_ps(p26, p37, 0x31));
+        }
+        interleave4SSE42(out + i * 4, r + i, g + i, b + i, a + i, count - i);
+    }
+
+    __attribute__((target("avx2")))
+    inline void deinterleave4AVX2(const float* in, float* r, float* g, float* b, float* a, int count) {
+        int i = 0;
+        for(; i + 8 <= count; i += 8) {
+            __m256 p01 = _mm256_loadu_ps(in + i * 4), p23 = _mm256_loadu_ps(in + i * 4 + 8);
+            __m256 p45 = _mm256_loadu_ps(in + i * 4 + 16), p67 = _mm256_loadu_ps(in + i * 4 + 24);
+            __m256 p04 = _mm256_permute2f128_ps(p01, p45, 0x20), p15 = _mm256_permute2f128_ps(p01, p45, 0x31);
+            __m256 p26 = _mm256_permute2f128_ps(p23, p67, 0x20), p37 = _mm256_permute2f128_ps(p23, p67, 0x31);
+            __m256 rg01 = _mm256_unpacklo_ps(p04, p15), ba01 = _mm256_unpackhi_ps(p04, p15);
+            __m256 rg23 = _mm256_unpacklo_ps(p26, p37), ba23 = _mm256_unpackhi_ps(p26, p37);
+            _mm256_storeu_ps(r + i, _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(1, 0, 1, 0)));
+            _mm256_storeu_ps(g + i, _mm256_shuffle_ps(rg01, rg23, _MM_SHUFFLE(3, 2, 3, 2)));
+            _mm256_storeu_ps(b + i, _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(1, 0, 1, 0)));
+            _mm256_storeu_ps(a + i, _mm256_shuffle_ps(ba01, ba23, _MM_SHUFFLE(3, 2, 3, 2)));
+        }
+        deinterleave4SSE42(in + i * 4, r + i, g + i, b + i, a + i, count - i);
+    }
+
+#endif
+
+    // out[i * 4 + c] = planes[c][i], the AVX2 path also serves AVX-512
+    inline void interleave4(float* out, const float* r, const float* g, const float* b, const float* a, int count) {
+#ifdef _LIBQIMG_SIMD_X86_
+        SIMDLevel::SIMDLevel current = level();
+        if(current >= SIMDLevel::avx2) {
+            interleave4AVX2(out, r, g, b, a, count);
+            return;
+        }
+        if(current >= SIMDLevel::sse42) {
+            interleave4SSE42(out, r, g, b, a, count);
+            return;
+        }
+#endif
+        interleave4Scalar(out, r, g, b, a, count);
+    }
+
+    // planes[c][i] = in[i * 4 + c], the AVX2 path also serves AVX-512
+    inline void deinterleave4(const float* in, float* r, float* g, float* b, float* a, int count) {
+#ifdef _LIBQIMG_SIMD_X86_
+        SIMDLevel::SIMDLevel current = level();
+        if(current >= SIMDLevel::avx2) {
+            deinterleave4AVX2(in, r, g, b, a, count);
+            return;
+        }
+        if(current >= SIMDLevel::sse42) {
+            deinterleave4SSE42(in, r, g, b, a, count);
+            return;
+        }
+#endif
+        deinterleave4Scalar(in, r, g, b, a, count);
+    }
+
+    // out[i] = sum of taps[t] * in[i + t], added to out if accumulate. in must hold count + tapCount - 1 floats.
+    inline void rowTaps(float* out, const float* in, int count, const float* taps, int tapCount, bool accumulate = false) {
+#ifdef _LIBQIMG_SIMD_X86_
+        switch (level()) {
+            case SIMDLevel::avx512:
+                rowTapsAVX512(out, in, count, taps, tapCount, accumulate);
+                return;
+            case SIMDLevel::avx2:
+                rowTapsAVX2(out, in, count, taps, tapCount, accumulate);
+                return;
+            case SIMDLevel::sse42:
+                rowTapsSSE42(out, in, count, taps, tapCount, accumulate);
+                return;
+            default:
+                break;
+        }
+#endif
+        rowTapsScalar(out, in, count, taps, tapCount, accumulate);
+    }
+
+    // out[i] = sum of taps[t] * in[t * lineStride + i], lines are lineStride floats apart
+    inline void columnTaps(float* out, const float* in, size_t lineStride, int count, const float* taps, int tapCount) {
+#ifdef _LIBQIMG_SIMD_X86_
+        switch (level()) {
+            case SIMDLevel::avx512:
+                columnTapsAVX512(out, in, lineStride, count, taps, tapCount);
+                return;
+            case SIMDLevel::avx2:
+                columnTapsAVX2(out, in, lineStride, count, taps, tapCount);
+                return;
+            case SIMDLevel::sse42:
+                columnTapsSSE42(out, in, lineStride, count, taps, tapCount);
+                return;
+            default:
+                break;
+        }
+#endif
+        columnTapsScalar(out, in, lineStride, count, taps, tapCount);
+    }
+
+    /*
+        Half Conversion
+        halfToFloat : out[i] = binary16 in[i] as float, always exact
+        floatToHalf : out[i] = in[i] rounded to the nearest binary16, ties to even
+        The scalar path gives the same bits as the F16C instructions, NaNs keep their payload and become quiet.
+    */
+
+    inline float halfBitsToFloat(uint16_t half) {
+        uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+        uint32_t exponent = (half >> 10) & 0x1F, mantissa = half & 0x3FF;
+        uint32_t bits;
+        if(exponent == 0) {
+            // Zero and subnormals, mantissa * 2^-24 is exact in float
+            float value = (float)mantissa * 5.9604644775390625e-8f;
+            memcpy(&bits, &value, 4);
+            bits |= sign;
+        } else if(exponent == 0x1F)
+            bits = sign | 0x7F800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+        else
+            bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+        float result;
+        memcpy(&result, &bits, 4);
+        return result;
+    }
+
+    inline uint16_t floatToHalfBits(float value) {
+        uint32_t bits;
+        memcpy(&bits, &value, 4);
+        uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+        bits &= 0x7FFFFFFF;
+        // Infinity and NaN
+        if(bits >= 0x7F800000)
+            return sign | (bits > 0x7F800000 ? (uint16_t)(0x7E00 | ((bits & 0x7FFFFF) >> 13)) : (uint16_t)0x7C00);
+        // At least 65520, rounds to infinity
+        if(bits >= 0x477FF000)
+            return sign | 0x7C00;
+        // Below the smallest normal half, the float adder rounds the mantissa into place
+        if(bits < 0x38800000) {
+            const uint32_t magicBits = 0x3F000000;
+            float magic, shifted;
+            memcpy(&magic, &magicBits, 4);
+            memcpy(&shifted, &bits, 4);
+            shifted += magic;
+            memcpy(&bits, &shifted, 4);
+            return sign | (uint16_t)(bits - magicBits);
+        }
+        // Rebias the exponent and round the dropped 13 bits to even
+        bits += 0xC8000FFF + ((bits >> 13) & 1);
+        return sign | (uint16_t)(bits >> 13);
+    }
+
+    inline void halfToFloatScalar(float* out, const uint16_t* in, int count) {
+        for(int i = 0; i < count; i++)
+            out[i] = halfBitsToFloat(in[i]);
+    }
+
+    inline void floatToHalfScalar(uint16_t* out, const float* in, int count) {
+        for(int i = 0; i < count; i++)
+            out[i] = floatToHalfBits(in[i]);
+    }
+
+#ifdef _LIBQIMG_SIMD_X86_
+
+    // Return true if the CPU has the F16C conversions, they are a separate feature bit from AVX2
+    inline bool supportsF16C() {
+        static const bool supported = []() {
+            __builtin_cpu_init();
+            return (bool)__builtin_cpu_supports("f16c");
+        }();
+        return supported;
+    }
+
+    // F16C, 8 conversions per instruction
+    __attribute__((target("avx2,f16c")))
+    inline void halfToFloatF16C(float* out, const uint16_t* in, int count) {
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+        halfToFloatScalar(out + i, in + i, count - i);
+    }
+
+    __attribute__((target("avx2,f16c")))
+    inline void floatToHalfF16C(uint16_t* out, const float* in, int count) {
+        int i = 0;
+        for(; i + 8 <= count; i += 8)
+            _mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+        floatToHalfScalar(out + i, in + i, count - i);
+    }
+
+#endif
+
+    // out[i] = in[i] as float, the F16C path is taken from AVX2 on if the CPU reports F16C
+    inline void halfToFloat(float* out, const uint16_t* in, int count) {
+#ifdef _LIBQIMG_SIMD_X86_
+        if(level() >= SIMDLevel::avx2 && supportsF16C()) {
+            halfToFloatF16C(out, in, count);
+            return;
+        }
+#endif
+        halfToFloatScalar(out, in, count);
+    }
+
+    // out[i] = in[i] rounded to half, the F16C path is taken from AVX2 on if the CPU reports F16C
+    inline void floatToHalf(uint16_t* out, const float* in, int count) {
+#ifdef _LIBQIMG_SIMD_X86_
+        if(level() >= SIMDLevel::avx2 && supportsF16C()) {
+            floatToHalfF16C(out, in, count);
+            return;
+        }
+#endif
+        floatToHalfScalar(out, in, count);
+    }
+
+}
+
+#endif
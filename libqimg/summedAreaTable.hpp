@@ -0,0 +1,153 @@
+//  Copyright 2021 Isoheptane
+//  Filename    : summedAreaTable.hpp
+//  Purpose     : Summed-Area Table (Integral Image) of FloatPointMatrix
+//  License     : MIT License
+
+#ifndef _LIBQIMG_SUMMEDAREATABLE_HPP_
+#define _LIBQIMG_SUMMEDAREATABLE_HPP_
+
+#include <cmath>
+#include <vector>
+
+#include "libqimg_math.hpp"
+#include "point.hpp"
+#include "fmat.hpp"
+#include "multiThread.hpp"
+
+namespace libqimg {
+
+    /*
+        Summed-Area Table
+        table(x, y) holds the sum of every pixel left and up of (x, y),
+        so it is (width + 1) x (height + 1) with a zero first row and column.
+        Pixel (x, y) covers the area [x, x + 1] x [y, y + 1].
+        Averages replicate the edge pixels outside the canvas like FMAT::average.
+    */
+
+    // Upper bound of columns processed by a single task when accumulating columns
+    const int SAT_COLUMN_GRAIN = 256;
+
+    // Summed-Area Table, answers rectangle sums and averages in constant time
+    class SummedAreaTable {
+      private:
+        Point size;
+        int tableWidth;
+        std::vector<double> table;
+
+        inline double& entry(int x, int y) { return table[(size_t)tableWidth * y + x]; }
+        inline double entry(int x, int y) const { return table[(size_t)tableWidth * y + x]; }
+
+      public:
+
+        // Build table from source, rows and columns are accumulated in parallel.
+        SummedAreaTable(
+            FMAT& source,
+            int threadCount = MultiThread::defaultThreadCount
+        ):size(source.canvasSize()), tableWidth(source.width() + 1) {
+
+            table.resize((size_t)tableWidth * (size.y + 1));
+            for(int x = 0; x < tableWidth; x++)
+                entry(x, 0) = 0.0;
+            // Row prefix sums
+            MultiThread::parallelFor(size.y, [this, &source](int y) {
+                const float* row = source.rowPtr(y);
+                double* sum = &entry(0, y + 1);
+                sum[0] = 0.0;
+                for(int x = 0; x < size.x; x++)
+                    sum[x + 1] = sum[x] + (double)row[x];
+            }, threadCount);
+            // Column prefix sums, each task owns a band of columns
+            int bandWidth = MultiThread::columnBandWidth(Point(tableWidth, size.y), threadCount, SAT_COLUMN_GRAIN);
+            int bandCount = (tableWidth + bandWidth - 1) / bandWidth;
+            MultiThread::parallelFor(bandCount, [this, bandWidth](int band) {
+                int begin = band * bandWidth;
+                int end = math::min(begin + bandWidth, tableWidth);
+                for(int y = 1; y <= size.y; y++) {
+                    const double* up = &entry(0, y - 1);
+                    double* current = &entry(0, y);
+                    for(int x = begin; x < end; x++)
+                        current[x] += up[x];
+                }
+            }, threadCount);
+        }
+
+        // Free memory, the table is left empty
+        void dispose() {
+            std::vector<double>().swap(table);
+            size = Point(0, 0);
+            tableWidth = 1;
+        }
+
+        inline Point canvasSize() const { return size; }
+        inline int width() const { return size.x; }
+        inline int height() const { return size.y; }
+
+        // Return the sum of pixels from begin to end, both included. The rectangle is clamped to the canvas.
+        double sum(Point begin, Point end) const {
+            int x0 = math::clamp(begin.x, 0, size.x), y0 = math::clamp(begin.y, 0, size.y);
+            int x1 = math::clamp(end.x + 1, 0, size.x), y1 = math::clamp(end.y + 1, 0, size.y);
+            if(x1 <= x0 || y1 <= y0) return 0.0;
+            return entry(x1, y1) - entry(x0, y1) - entry(x1, y0) + entry(x0, y0);
+        }
+
+        // Return the integral from the left up corner to point, the point is clamped to the canvas.
+        double integral(PointF point) const {
+            if(size.x <= 0 || size.y <= 0) return 0.0;
+            float px = math::clamp(point.x, 0.0f, (float)size.x);
+            float py = math::clamp(point.y, 0.0f, (float)size.y);
+            int ix = math::min((int)floorf(px), size.x - 1);
+            int iy = math::min((int)floorf(py), size.y - 1);
+            double fx = (double)px - ix, fy = (double)py - iy;
+            // Pixels are constant, so the integral is bilinear inside a pixel
+            double up = entry(ix, iy) + (entry(ix + 1, iy) - entry(ix, iy)) * fx;
+            double down = entry(ix, iy + 1) + (entry(ix + 1, iy + 1) - entry(ix, iy + 1)) * fx;
+            return up + (down - up) * fy;
+        }
+
+        // Return the integral from the left up corner to point with the edge pixels replicated outside the canvas,
+        // area left or up of the corner counts negative.
+        double extendedIntegral(PointF point) const {
+            if(size.x <= 0 || size.y <= 0) return 0.0;
+            float cx = math::clamp(point.x, 0.0f, (float)size.x);
+            float cy = math::clamp(point.y, 0.0f, (float)size.y);
+            double total = integral(PointF(cx, cy));
+            // Beyond the canvas the edge row, the edge column and the corner pixel are extended
+            int edgeX = point.x < 0.0f ? 0 : size.x - 1;
+            int edgeY = point.y < 0.0f ? 0 : size.y - 1;
+            double outX = (double)point.x - cx, outY = (double)point.y - cy;
+            if(outY != 0.0)
+                total += outY * (integral(PointF(cx, (float)(edgeY + 1))) - integral(PointF(cx, (float)edgeY)));
+            if(outX != 0.0)
+                total += outX * (integral(PointF((float)(edgeX + 1), cy)) - integral(PointF((float)edgeX, cy)));
+            if(outX != 0.0 && outY != 0.0)
+                total += outX * outY * sum(Point(edgeX, edgeY), Point(edgeX, edgeY));
+            return total;
+        }
+
+        // Return the average value of the appointed chunk, both corners included.
+        float average(Point begin, Point end) const {
+            return average(PointF((float)begin.x, (float)begin.y), PointF((float)end.x + 1.0f, (float)end.y + 1.0f));
+        }
+
+        // Return the average value of the area from lu to rd, fractional corners are weighted by coverage.
+        float average(PointF lu, PointF rd) const {
+            double total = extendedIntegral(rd) - extendedIntegral(PointF(lu.x, rd.y))
+                - extendedIntegral(PointF(rd.x, lu.y)) + extendedIntegral(lu);
+            return (float)(total / ((double)(rd.x - lu.x) * (double)(rd.y - lu.y)));
+        }
+
+        // Return the average of the box around center, the box is cropped by the canvas.
+        float boxAverage(Point center, Point radius) const {
+            int x0 = math::max(center.x - radius.x, 0), y0 = math::max(center.y - radius.y, 0);
+            int x1 = math::min(center.x + radius.x, size.x - 1), y1 = math::min(center.y + radius.y, size.y - 1);
+            if(x1 < x0 || y1 < y0) return 0.0f;
+            return average(Point(x0, y0), Point(x1, y1));
+        }
+
+    };
+    // Summed-Area Table
+    typedef SummedAreaTable SAT;
+
+}
+
+#endif
@@ -7,18 +7,57 @@
 #ifndef _LIBQIMG_TILEMODE_HPP_
 #define _LIBQIMG_TILEMODE_HPP_
 
+#include <type_traits>
+
 #include "libqimg_math.hpp"
 
 namespace libqimg::TileMode {
     
     // Tile Mode selection
     enum TileMode {
+        // Pixels outside the canvas read as zero
         empty = 0,
+        // Repeat the edge pixel
         clamp = 1,
+        // Wrap around, the canvas is tiled
         repeat = 2,
+        // Reflect at the edges, the edge pixel is repeated once: ... 1 0 | 0 1 2 ...
         mirror = 3
     };
 
+    // Map coordinate x into [0, size) by tile mode, empty is mapped like clamp
+    template <TileMode tileMode>
+    inline int resolve(int x, int size) {
+        if constexpr (tileMode == repeat)
+            return math::mod(x, size);
+        else if constexpr (tileMode == mirror) {
+            int position = math::mod(x, size * 2);
+            return position < size ? position : size * 2 - 1 - position;
+        } else
+            return math::clamp(x, 0, size - 1);
+    }
+
+    // Map coordinate x into [0, size) by tile mode, empty is mapped like clamp
+    inline int resolve(int x, int size, TileMode tileMode) {
+        switch (tileMode) {
+            case repeat: return resolve<repeat>(x, size);
+            case mirror: return resolve<mirror>(x, size);
+            default: return resolve<clamp>(x, size);
+        }
+    }
+
+    // Call function once with the tile mode as a compile-time constant: function(std::integral_constant<TileMode, mode>())
+    // Unknown modes are dispatched as empty.
+    template <class Function>
+    inline decltype(auto) dispatch(TileMode tileMode, Function&& function) {
+        switch (tileMode) {
+            case clamp: return function(std::integral_constant<TileMode, clamp>());
+            case repeat: return function(std::integral_constant<TileMode, repeat>());
+            case mirror: return function(std::integral_constant<TileMode, mirror>());
+            default: return function(std::integral_constant<TileMode, empty>());
+        }
+    }
+
 }
 
 #endif
\ No newline at end of file